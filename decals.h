@@ -0,0 +1,221 @@
+#pragma once
+#include "globals.h"
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+namespace Decals
+{
+    enum Face
+    {
+        North,
+        South,
+        West,
+        East
+    };
+
+    enum Kind
+    {
+        BulletHole,
+        Scorch
+    };
+
+    // tiles line up with the 32x32 wall textures so a decal texel is addressed with the same u/v as the wall texel
+    const int tileSize = 32;
+    // fixed budget: 256 tiles * 32 * 32 * 4 bytes = 1 MB, the least recently seen/stamped face gives up its tile
+    const int maxTiles = 256;
+
+    struct Tile
+    {
+        int face = -1;
+        uint64_t lastUsed = 0;
+    };
+
+    std::vector<uint32_t> atlas(maxTiles * tileSize * tileSize);
+    Tile tiles[maxTiles];
+    std::vector<int> faceTiles;
+    uint64_t frame = 1;
+
+    int faceKey(int cell, Face face) { return cell * 4 + face; }
+
+    void reset()
+    {
+        faceTiles.assign(mapX * mapY * 4, -1);
+        for (auto &tile : tiles)
+        {
+            tile = Tile();
+        }
+    }
+
+    // read only so views can look tiles up from several threads, report what was drawn through touchTile afterwards
+    int tileForFace(int face)
+    {
+        if (face < 0 || face >= faceTiles.size())
+        {
+            return -1;
+        }
+        return faceTiles[face];
+    }
+
+    void touchTile(int tile)
+    {
+        tiles[tile].lastUsed = frame;
+    }
+
+    int acquireTile(int face)
+    {
+        int tile = faceTiles[face];
+        if (tile != -1)
+        {
+            return tile;
+        }
+
+        tile = 0;
+        for (int i = 1; i < maxTiles && tiles[tile].face != -1; i++)
+        {
+            if (tiles[i].face == -1 || tiles[i].lastUsed < tiles[tile].lastUsed)
+            {
+                tile = i;
+            }
+        }
+        if (tiles[tile].face != -1)
+        {
+            faceTiles[tiles[tile].face] = -1;
+        }
+
+        tiles[tile].face = face;
+        faceTiles[face] = tile;
+        std::fill(atlas.begin() + tile * tileSize * tileSize, atlas.begin() + (tile + 1) * tileSize * tileSize, 0);
+        return tile;
+    }
+
+    uint32_t texel(int tile, int u, int v)
+    {
+        u = std::clamp(u, 0, tileSize - 1);
+        v = std::clamp(v, 0, tileSize - 1);
+        return atlas[(tile * tileSize + v) * tileSize + u];
+    }
+
+    uint32_t blend(uint32_t base, uint32_t decal)
+    {
+        uint32_t alpha = decal >> 24;
+        if (alpha == 0)
+        {
+            return base;
+        }
+        uint32_t result = 0xFF000000u;
+        for (int shift = 0; shift < 24; shift += 8)
+        {
+            uint32_t a = (base >> shift) & 0xFF;
+            uint32_t b = (decal >> shift) & 0xFF;
+            result |= ((a * (255 - alpha) + b * alpha) / 255) << shift;
+        }
+        return result;
+    }
+
+    // u/v are wall texel coordinates of the impact centre
+    void stamp(int face, float u, float v, Kind kind)
+    {
+        if (face < 0 || face >= faceTiles.size())
+        {
+            return;
+        }
+        int tile = acquireTile(face);
+        tiles[tile].lastUsed = frame;
+
+        float radius = kind == BulletHole ? 1.6f : 9.0f;
+        uint32_t color = kind == BulletHole ? 0x101010 : 0x0A1420;
+        float strength = kind == BulletHole ? 235 : 200;
+
+        for (int y = std::max(0, static_cast<int>(v - radius)); y <= std::min(tileSize - 1, static_cast<int>(v + radius)); y++)
+        {
+            for (int x = std::max(0, static_cast<int>(u - radius)); x <= std::min(tileSize - 1, static_cast<int>(u + radius)); x++)
+            {
+                float dx = x + 0.5f - u;
+                float dy = y + 0.5f - v;
+                float falloff = 1.0f - std::sqrt(dx * dx + dy * dy) / radius;
+                if (falloff <= 0)
+                    continue;
+                if (kind == Scorch)
+                {
+                    // uneven soot so overlapping blasts don't look like stamped circles
+                    falloff *= 0.6f + 0.4f * ((x * 7 + y * 13 + static_cast<int>(u * 3)) % 5) / 4.0f;
+                }
+                else
+                {
+                    falloff = std::min(1.0f, falloff * 2.5f);
+                }
+
+                uint32_t &pixel = atlas[(tile * tileSize + y) * tileSize + x];
+                uint32_t oldAlpha = pixel >> 24;
+                uint32_t newAlpha = static_cast<uint32_t>(strength * falloff);
+                uint32_t alpha = std::min(255u, newAlpha + oldAlpha * (255 - newAlpha) / 255);
+                pixel = (alpha << 24) | color;
+            }
+        }
+    }
+
+    void clearCell(int cell)
+    {
+        for (int face = 0; face < 4; face++)
+        {
+            int key = faceKey(cell, static_cast<Face>(face));
+            if (key < 0 || key >= faceTiles.size() || faceTiles[key] == -1)
+                continue;
+            tiles[faceTiles[key]].face = -1;
+            tiles[faceTiles[key]].lastUsed = 0;
+            faceTiles[key] = -1;
+        }
+    }
+
+    // wall texel row a sprite at height z projects onto; walls span 32 texels over 64 units around the horizon
+    float impactHeight(float z, float fov)
+    {
+        return tileSize / 2 + z * (512.0f / tan(fov / 2 * M_PI / 180.0)) / 1024;
+    }
+
+    // Finds the face and texel column where a segment from (fromX, fromY) entered the wall cell containing (toX, toY)
+    int wallImpact(float fromX, float fromY, float toX, float toY, float &u)
+    {
+        int fromCellX = floor(fromX / cellWidth);
+        int fromCellY = floor(fromY / cellWidth);
+        int cellX = floor(toX / cellWidth);
+        int cellY = floor(toY / cellWidth);
+        if (cellX < 0 || cellX >= mapX || cellY < 0 || cellY >= mapY)
+        {
+            return -1;
+        }
+        int cell = cellY * mapX + cellX;
+
+        float dx = toX - fromX;
+        float dy = toY - fromY;
+        float tX = 2;
+        float tY = 2;
+        if (cellX != fromCellX && dx != 0)
+        {
+            float boundary = (cellX > fromCellX ? cellX : cellX + 1) * cellWidth;
+            tX = (boundary - fromX) / dx;
+        }
+        if (cellY != fromCellY && dy != 0)
+        {
+            float boundary = (cellY > fromCellY ? cellY : cellY + 1) * cellWidth;
+            tY = (boundary - fromY) / dy;
+        }
+        if (tX == 2 && tY == 2)
+        {
+            return -1;
+        }
+
+        // the later crossing is the one into the wall cell itself
+        if (tY == 2 || (tX != 2 && tX > tY))
+        {
+            float hitY = fromY + dy * tX;
+            u = (hitY - cellY * cellWidth) / 2.0f;
+            return faceKey(cell, cellX > fromCellX ? West : East);
+        }
+        float hitX = fromX + dx * tY;
+        u = (hitX - cellX * cellWidth) / 2.0f;
+        return faceKey(cell, cellY > fromCellY ? North : South);
+    }
+}
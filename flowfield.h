@@ -0,0 +1,146 @@
+#pragma once
+#include "globals.h"
+#include <cmath>
+#include <vector>
+
+namespace FlowField
+{
+    // Breadth first distances in cells from the nearest player over the open cells of map, shared by every enemy.
+    // A new field is grown a slice per frame once the players changed cell or a tile changed, enemies keep
+    // following the last finished one until it is ready
+    const int cellsPerFrame = 512;
+
+    // finished field: steps to the nearest player or -1 when cut off, and the neighbour each cell leads to
+    std::vector<int> distances;
+    std::vector<int> nextCells;
+
+    std::vector<int> building;
+    std::vector<int> queue;
+    int queueHead = 0;
+    std::vector<int> targets;
+    bool growing = false;
+    bool dirty = true;
+
+    bool open(int cellX, int cellY)
+    {
+        return cellX >= 0 && cellX < mapX && cellY >= 0 && cellY < mapY && map[cellY * mapX + cellX] == 0;
+    }
+
+    // call when a tile opens or closes
+    void markDirty()
+    {
+        dirty = true;
+    }
+
+    void start()
+    {
+        building.assign(mapX * mapY, -1);
+        queue.clear();
+        queueHead = 0;
+        for (int cell : targets)
+        {
+            if (cell < 0 || cell >= building.size() || map[cell] != 0 || building[cell] == 0)
+                continue;
+            building[cell] = 0;
+            queue.push_back(cell);
+        }
+        growing = true;
+    }
+
+    // Each cell leads to the neighbour closest to a player, diagonals only when both cells beside them are open
+    // so nobody cuts a wall corner
+    void finish()
+    {
+        const int steps[8][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}, {1, 1}, {1, -1}, {-1, 1}, {-1, -1}};
+        nextCells.assign(mapX * mapY, -1);
+        for (int cell = 0; cell < building.size(); cell++)
+        {
+            if (building[cell] <= 0)
+                continue;
+            int cellX = cell % mapX;
+            int cellY = cell / mapX;
+            int best = building[cell];
+            for (const auto &step : steps)
+            {
+                int x = cellX + step[0];
+                int y = cellY + step[1];
+                if (!open(x, y) || !open(cellX + step[0], cellY) || !open(cellX, cellY + step[1]))
+                    continue;
+                int distance = building[y * mapX + x];
+                if (distance != -1 && distance < best)
+                {
+                    best = distance;
+                    nextCells[cell] = y * mapX + x;
+                }
+            }
+        }
+        distances.swap(building);
+        growing = false;
+    }
+
+    // Call once per frame with the cells the players stand in
+    void update(const std::vector<int> &playerCells)
+    {
+        if (!growing && (dirty || playerCells != targets))
+        {
+            targets = playerCells;
+            dirty = false;
+            start();
+        }
+        if (!growing)
+            return;
+
+        const int steps[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+        for (int budget = cellsPerFrame; budget > 0 && queueHead < queue.size(); budget--)
+        {
+            int cell = queue[queueHead++];
+            for (const auto &step : steps)
+            {
+                int x = cell % mapX + step[0];
+                int y = cell / mapX + step[1];
+                if (!open(x, y) || building[y * mapX + x] != -1)
+                    continue;
+                building[y * mapX + x] = building[cell] + 1;
+                queue.push_back(y * mapX + x);
+            }
+        }
+        if (queueHead == queue.size())
+        {
+            finish();
+        }
+    }
+
+    // Points (dirX, dirY) at the centre of the next cell on the way to the nearest player. False when (x, y) is in a
+    // player's cell or cut off from every player, the caller then keeps its own direction
+    bool steer(float x, float y, float &dirX, float &dirY)
+    {
+        int cellX = floor(x / cellWidth);
+        int cellY = floor(y / cellWidth);
+        if (cellX < 0 || cellX >= mapX || cellY < 0 || cellY >= mapY || nextCells.size() != mapX * mapY)
+            return false;
+        int next = nextCells[cellY * mapX + cellX];
+        if (next == -1)
+            return false;
+        float deltaX = (next % mapX + 0.5f) * cellWidth - x;
+        float deltaY = (next / mapX + 0.5f) * cellWidth - y;
+        float length = std::sqrt(deltaX * deltaX + deltaY * deltaY);
+        if (length == 0)
+            return false;
+        dirX = deltaX / length;
+        dirY = deltaY / length;
+        return true;
+    }
+
+    // call once the map of a new level is loaded
+    void reset()
+    {
+        distances.clear();
+        nextCells.clear();
+        building.clear();
+        queue.clear();
+        queueHead = 0;
+        targets.clear();
+        growing = false;
+        dirty = true;
+    }
+}
@@ -13,6 +13,7 @@ Game::Game()
   window = initWindow();
   initIcon(window);
   renderer = initRenderer(window);
+  frameTexture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, screenWidth, screenHeight);
 
   loadSound("./sounds/pickupCoin.wav");
   loadSound("./sounds/shoot.wav");
@@ -42,19 +43,43 @@ Game::Game()
   titleRect = {512 - ((titleTextSurface->w * 3) / 2), 60, titleTextSurface->w * 3, titleTextSurface->h * 3};
   SDL_FreeSurface(titleTextSurface);
 
-  player = {{80.0f, 80.0f}, 0.0f, 60};
+  setCoop(false);
+  resetPlayers();
 
   deserializePlayer("save.dat");
 
+  PostProcess::init();
+
   Achievements::update();
 }
 
 void Game::run()
 {
-  auto startTime = std::chrono::high_resolution_clock::now();
-  lastTime = std::chrono::high_resolution_clock::now();
+  auto startTime = std::chrono::steady_clock::now();
+  lastTime = std::chrono::steady_clock::now();
+  // the tick of the world started in one frame runs on the simulation thread while that frame is drawn
+  bool ticking = false;
+  float tickMs = 0;
+  auto tick = [&]()
+  {
+    auto tickStart = std::chrono::steady_clock::now();
+    simulate();
+    tickMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - tickStart).count();
+  };
   while (gameRunning)
   {
+    // nothing of the world is touched on this thread until the last tick is done
+    SimThread::wait();
+    if (ticking)
+    {
+      finishTick();
+      ticking = false;
+      if (FrameStats::enabled)
+      {
+        FrameStats::simMs += tickMs;
+      }
+    }
+
     if (musicChannel == -1)
     {
       musicChannel = Mix_PlayChannel(-1, sounds.at(4), 0);
@@ -64,8 +89,9 @@ void Game::run()
       musicChannel = Mix_PlayChannel(-1, sounds.at(4), 0);
     }
 
-    distances.clear();
-    currentTime = std::chrono::high_resolution_clock::now();
+    Decals::frame++;
+    SpriteCache::frame++;
+    currentTime = std::chrono::steady_clock::now();
     std::chrono::duration<float> elapsed = currentTime - startTime;
     deltaTime = ((std::chrono::duration<float>)(currentTime - lastTime)).count();
 
@@ -103,28 +129,60 @@ void Game::run()
 
     handleInput();
 
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-    SDL_RenderClear(renderer);
+    auto frameStart = std::chrono::steady_clock::now();
 
-    SDL_SetRenderDrawColor(renderer, 100, 100, 100, 255);
-    SDL_Rect bottomBackground;
-    bottomBackground.x = 0;
-    bottomBackground.h = 256;
-    bottomBackground.y = 256;
-    bottomBackground.w = 1024;
-    SDL_RenderFillRect(renderer, &bottomBackground);
+    // the world is simulated once per frame no matter how many players are looking at it
+    Pvs::update();
+    handleTriggers();
+    handlePickups();
+    publishSnapshot();
+    SimThread::start(tick);
+    ticking = true;
+
+    std::fill(frameBuffer.begin(), frameBuffer.begin() + screenWidth * (screenHeight / 2), packColor(51, 197, 255));
+    std::fill(frameBuffer.begin() + screenWidth * (screenHeight / 2), frameBuffer.end(), packColor(100, 100, 100));
+
+    Jobs::parallelFor(views.size(), [this](int view)
+                      { renderView(views[view]); });
+
+    // sprites are drawn once every view has sorted them, strips of all views share one batch
+    std::vector<std::pair<int, int>> strips;
+    for (int view = 0; view < views.size(); view++)
+    {
+      for (int strip = 0; strip < views[view].strips.size(); strip++)
+      {
+        strips.push_back({view, strip});
+      }
+    }
+    Jobs::parallelFor(strips.size(), [&](int job)
+                      { renderStrip(views[strips[job].first], views[strips[job].first].strips[strips[job].second]); });
 
-    SDL_SetRenderDrawColor(renderer, 51, 197, 255, 255);
-    SDL_Rect topBackground;
-    topBackground.x = 0;
-    topBackground.h = 256;
-    topBackground.y = 0;
-    topBackground.w = 1024;
-    SDL_RenderFillRect(renderer, &topBackground);
+    // views only read shared state while drawing, what they saw is applied here in a fixed order
+    for (auto &view : views)
+    {
+      for (int cell : view.seenCells)
+      {
+        Minimap::reveal(cell);
+      }
+      for (int tile : view.seenDecalTiles)
+      {
+        Decals::touchTile(tile);
+      }
+    }
 
-    raycast(renderer);
+    auto renderEnd = std::chrono::steady_clock::now();
 
-    handleSprites(renderer);
+    PostProcess::apply(currentTime, health);
+
+    SDL_UpdateTexture(frameTexture, NULL, frameBuffer.data(), screenWidth * sizeof(uint32_t));
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    SDL_RenderClear(renderer);
+    SDL_RenderCopy(renderer, frameTexture, NULL, NULL);
+
+    if (bossHealth.has_value())
+    {
+      renderHealthBar(renderer, bossHealth.value(), font);
+    }
 
     std::string text = "Health: " + std::to_string(health);
     SDL_Surface *textSurface = TTF_RenderText_Solid(font, text.c_str(), healthTextColor);
@@ -156,19 +214,40 @@ void Game::run()
     SDL_DestroyTexture(healthText);
     SDL_DestroyTexture(coinText);
 
-    SDL_Rect crosshairRect = {512 - 5, 256 - 5, 10, 10};
-    SDL_RenderCopy(renderer, crosshair, NULL, &crosshairRect);
+    Minimap::render(renderer, views);
+
+    for (const auto &view : views)
+    {
+      SDL_Rect crosshairRect = {view.viewX + view.viewWidth / 2 - 5, 256 - 5, 10, 10};
+      SDL_RenderCopy(renderer, crosshair, NULL, &crosshairRect);
+    }
+    if (views.size() > 1)
+    {
+      SDL_Rect dividerRect = {screenWidth / 2 - 1, 0, 2, screenHeight};
+      SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+      SDL_RenderFillRect(renderer, &dividerRect);
+    }
 
     SDL_RenderPresent(renderer);
 
+    if (FrameStats::enabled)
+    {
+      FrameStats::renderMs += std::chrono::duration<float, std::milli>(renderEnd - frameStart).count();
+      FrameStats::frameMs += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+      FrameStats::report();
+    }
+
     SDL_Delay(16);
   }
+  SimThread::stop();
   serializePlayer("save.dat");
 
   for (auto sound : sounds)
   {
     Mix_FreeChunk(sound);
   }
+  Jobs::stop();
+  SDL_DestroyTexture(frameTexture);
   Mix_CloseAudio();
   SDL_DestroyRenderer(renderer);
   SDL_DestroyWindow(window);
@@ -234,8 +313,106 @@ void Game::initIcon(SDL_Window *window)
   }
 }
 
-void Game::raycast(SDL_Renderer *renderer)
+void Game::resetPlayers()
+{
+  for (auto &local : players)
+  {
+    local.player = {{80.0f, 80.0f}, 0.0f, 60};
+    local.lastBulletTime = currentTime;
+    local.shootPressed = false;
+  }
+}
+
+// the second player joins where the first one is standing and the screen is split down the middle
+void Game::setCoop(bool enabled)
+{
+  players.resize(enabled ? 2 : 1);
+  players[0].bindings = playerOneBindings;
+  if (enabled)
+  {
+    players[1].player = players[0].player;
+    players[1].bindings = playerTwoBindings;
+    players[1].lastBulletTime = currentTime;
+  }
+
+  int viewWidth = screenWidth / players.size();
+  for (int p = 0; p < players.size(); p++)
+  {
+    players[p].viewX = p * viewWidth;
+    players[p].viewWidth = viewWidth;
+  }
+}
+
+const Player &Game::nearestPlayer(float x, float y)
+{
+  const Player *nearest = &players[0].player;
+  float nearestDistance = glm::distance(glm::vec2(x, y), nearest->pos);
+  for (const auto &local : players)
+  {
+    float distance = glm::distance(glm::vec2(x, y), local.player.pos);
+    if (distance < nearestDistance)
+    {
+      nearest = &local.player;
+      nearestDistance = distance;
+    }
+  }
+  return *nearest;
+}
+
+// one bit test per player against the PVS of the cell they stand in
+bool Game::playersMaySee(float x, float y)
+{
+  int cell = getCell(floor(x / cellWidth), floor(y / cellWidth));
+  for (const auto &local : players)
+  {
+    if (Pvs::visible(getCell(floor(local.player.pos.x / cellWidth), floor(local.player.pos.y / cellWidth)), cell))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Draws the walls of one player's view into their columns of the framebuffer and sorts the sprites it sees
+// into strips, may run on a worker thread
+void Game::renderView(LocalPlayer &view)
 {
+  view.distances.clear();
+  if (view.visitedMarks.size() != mapX * mapY)
+  {
+    view.visitedMarks.assign(mapX * mapY, 0);
+    view.gatheredMarks.assign(mapX * mapY, 0);
+    view.visitedCells.clear();
+    view.gatheredCells.clear();
+  }
+  for (int cell : view.visitedCells)
+  {
+    view.visitedMarks[cell] = 0;
+  }
+  for (int cell : view.gatheredCells)
+  {
+    view.gatheredMarks[cell] = 0;
+  }
+  view.visitedCells.clear();
+  view.gatheredCells.clear();
+  view.seenCells.clear();
+  view.seenDecalTiles.clear();
+  raycast(view);
+  view.depthTree.build(view.distances);
+  gatherSprites(view);
+}
+
+void Game::raycast(LocalPlayer &view)
+{
+  const QualitySettings &quality = qualityPresets[qualityPreset];
+  const Player &player = view.player;
+  int playerCell = getCell(floor(player.pos.x / cellWidth), floor(player.pos.y / cellWidth));
+  view.seenCells.push_back(playerCell);
+  if (playerCell != -1)
+  {
+    view.visitedMarks[playerCell] = 1;
+    view.visitedCells.push_back(playerCell);
+  }
   float rayAngle = FixAngle(player.angle - (player.FOV / 2));
 
   for (float i = 0; i < player.FOV; i += rayStep)
@@ -245,13 +422,16 @@ void Game::raycast(SDL_Renderer *renderer)
     float dy;
     float dx;
 
+    view.rayCells.clear();
+
     float distanceHorizontal = 10000000;
     int cellIndexX;
     int cellIndexY = floor(rayY / cellWidth);
     int depth = 0;
 
-    int mappedPosHorizontal;
-    int hitTypeHorizontal;
+    float mappedPosHorizontal = 0;
+    int hitTypeHorizontal = 0;
+    int hitFaceHorizontal = -1;
 
     while (depth < maxDepth)
     {
@@ -280,6 +460,9 @@ void Game::raycast(SDL_Renderer *renderer)
       cellIndexY = floor(rayY / cellWidth);
 
       int mapCellIndex = getCell(cellIndexX, cellIndexY);
+      float crossingDistance = pow(rayX - player.pos.x, 2) + pow(rayY - player.pos.y, 2);
+      view.rayCells.emplace_back(mapCellIndex, crossingDistance);
+      view.rayCells.emplace_back(getCell(cellIndexX, cellIndexY - 1), crossingDistance);
 
       if (mapCellIndex == -1)
       {
@@ -288,15 +471,17 @@ void Game::raycast(SDL_Renderer *renderer)
       if (map[mapCellIndex] != 0)
       {
         hitTypeHorizontal = map[mapCellIndex];
+        hitFaceHorizontal = Decals::faceKey(mapCellIndex, Decals::North);
         depth = maxDepth;
-        mappedPosHorizontal = static_cast<int>((rayX - cellIndexX * cellWidth) / 2.0f);
+        mappedPosHorizontal = (rayX - cellIndexX * cellWidth) / 2.0f;
         distanceHorizontal = sqrt(pow(rayX - player.pos.x, 2) + pow(rayY - player.pos.y, 2));
       }
       if (map[getCell(cellIndexX, cellIndexY - 1)] != 0)
       {
         hitTypeHorizontal = map[getCell(cellIndexX, cellIndexY - 1)];
+        hitFaceHorizontal = Decals::faceKey(getCell(cellIndexX, cellIndexY - 1), Decals::South);
         depth = maxDepth;
-        mappedPosHorizontal = static_cast<int>((rayX - cellIndexX * cellWidth) / 2.0f);
+        mappedPosHorizontal = (rayX - cellIndexX * cellWidth) / 2.0f;
         distanceHorizontal = sqrt(pow(rayX - player.pos.x, 2) + pow(rayY - player.pos.y, 2));
       }
       depth++;
@@ -306,8 +491,9 @@ void Game::raycast(SDL_Renderer *renderer)
     float horizontalRayY = rayY;
     // vertical
 
-    int mappedPosVertical;
-    int hitTypeVertical;
+    float mappedPosVertical = 0;
+    int hitTypeVertical = 0;
+    int hitFaceVertical = -1;
 
     rayX = player.pos.x;
     rayY = player.pos.y;
@@ -343,6 +529,9 @@ void Game::raycast(SDL_Renderer *renderer)
       cellIndexX = floor(rayX / cellWidth);
       cellIndexY = floor(rayY / cellWidth);
       int mapCellIndex = getCell(cellIndexX, cellIndexY);
+      float crossingDistance = pow(rayX - player.pos.x, 2) + pow(rayY - player.pos.y, 2);
+      view.rayCells.emplace_back(mapCellIndex, crossingDistance);
+      view.rayCells.emplace_back(getCell(cellIndexX - 1, cellIndexY), crossingDistance);
 
       if (mapCellIndex == -1)
       {
@@ -352,15 +541,17 @@ void Game::raycast(SDL_Renderer *renderer)
       if (map[mapCellIndex] != 0)
       {
         hitTypeVertical = map[mapCellIndex];
+        hitFaceVertical = Decals::faceKey(mapCellIndex, Decals::West);
         depth = maxDepth;
-        mappedPosVertical = static_cast<int>((rayY - cellIndexY * cellWidth) / 2.0f);
+        mappedPosVertical = (rayY - cellIndexY * cellWidth) / 2.0f;
         distanceVertical = sqrt(pow(rayX - player.pos.x, 2) + pow(rayY - player.pos.y, 2));
       }
       if (map[getCell(cellIndexX - 1, cellIndexY)] != 0)
       {
         hitTypeVertical = map[getCell(cellIndexX - 1, cellIndexY)];
+        hitFaceVertical = Decals::faceKey(getCell(cellIndexX - 1, cellIndexY), Decals::East);
         depth = maxDepth;
-        mappedPosVertical = static_cast<int>((rayY - cellIndexY * cellWidth) / 2.0f);
+        mappedPosVertical = (rayY - cellIndexY * cellWidth) / 2.0f;
         distanceVertical = sqrt(pow(rayX - player.pos.x, 2) + pow(rayY - player.pos.y, 2));
       }
       depth++;
@@ -372,86 +563,151 @@ SDL_RenderDrawLine(renderer, player.pos.x, player.pos.y, horizontalRayX, horizon
 SDL_SetRenderDrawColor(renderer, 0, 255, 0, 255);
 SDL_RenderDrawLine(renderer, player.pos.x, player.pos.y, rayX, rayY);
 */
-    int mappedPos;
+    float mappedPos;
     int hitType;
+    int hitFace;
     // SDL_SetRenderDrawColor(renderer, 0, 0, 255, 255);
     if (distanceVertical < distanceHorizontal)
     {
       // SDL_RenderDrawLine(renderer, player.pos.x, player.pos.y, horizontalRayX, horizontalRayY);
       mappedPos = mappedPosVertical;
       hitType = hitTypeVertical;
-      SDL_SetRenderDrawColor(renderer, 0, 155, 0, 255);
+      hitFace = hitFaceVertical;
     }
     else
     {
       mappedPos = mappedPosHorizontal;
       hitType = hitTypeHorizontal;
-      SDL_SetRenderDrawColor(renderer, 0, 100, 0, 255);
+      hitFace = hitFaceHorizontal;
       // SDL_RenderDrawLine(renderer, player.pos.x, player.pos.y, rayX, rayY);
     }
 
     float distance = std::min(distanceHorizontal, distanceVertical);
     float correctedDistance = distance * cos(degToRad(FixAngle(player.angle - rayAngle)));
-    distances.emplace_back(distance);
-    SDL_FRect rectangle;
-    rectangle.x = i * (1024 / (player.FOV));
-    rectangle.h = (64 * 512) / correctedDistance;
-    rectangle.y = (512 / 2) - (rectangle.h / 2);
-    rectangle.w = (1024 / (player.FOV)) * rayStep;
-    // SDL_RenderFillRect(renderer, &rectangle);
+    view.distances.emplace_back(distance);
 
-    float smallRectHeight = rectangle.h / 32;
-
-    for (int j = 0; j < 32; j++)
+    // both marches run past the real hit, only cells crossed before it were actually seen
+    for (const auto &[cell, crossingDistance] : view.rayCells)
     {
-      Uint8 r, g, b;
-      getRGBFromTexture(hitType, mappedPos, j, r, g, b);
-      SDL_SetRenderDrawColor(renderer, r, g, b, 255);
-      float smallRectY = rectangle.y + j * smallRectHeight;
+      if (crossingDistance > distance * distance + 1 || cell == -1)
+        continue;
+      if (!view.visitedMarks[cell])
+      {
+        view.visitedMarks[cell] = 1;
+        view.visitedCells.push_back(cell);
+      }
+      if (!Minimap::isRevealed(cell))
+      {
+        view.seenCells.push_back(cell);
+      }
+    }
+
+    int columnStart = view.viewX + static_cast<int>(i * (view.viewWidth / (player.FOV)));
+    int columnEnd = std::min(view.viewX + static_cast<int>((i + rayStep) * (view.viewWidth / (player.FOV))), view.viewX + view.viewWidth);
 
-      SDL_FRect smallRect = rectangle;
-      smallRect.y = smallRectY;
-      smallRect.h = smallRectHeight;
+    float wallHeight = (64 * 512) / correctedDistance;
+    float wallTop = (512 / 2) - (wallHeight / 2);
+    // keep the wall span symmetric around the horizon so the mirrored ceiling rows meet it exactly
+    int wallEnd = std::min(screenHeight, static_cast<int>(std::ceil(wallTop + wallHeight)));
+    int wallStart = screenHeight - wallEnd;
+    float texelsPerRow = 32 / wallHeight;
 
-      SDL_RenderFillRectF(renderer, &smallRect);
+    if (hitType >= 1 && hitType <= loadedTextures.size())
+    {
+      const Texture *wallTexture = &loadedTextures[hitType - 1];
+      const Texture *wallTextures[4] = {wallTexture, wallTexture, wallTexture, wallTexture};
+      int decalTile = Decals::tileForFace(hitFace);
+      if (decalTile != -1)
+      {
+        view.seenDecalTiles.push_back(decalTile);
+      }
+      for (int y = wallStart; y < wallEnd; y += 4)
+      {
+        uint32_t texels[4];
+        int count = std::min(4, wallEnd - y);
+        if (quality.bilinearWalls)
+        {
+          float u[4] = {mappedPos, mappedPos, mappedPos, mappedPos};
+          float v[4];
+          for (int k = 0; k < 4; k++)
+          {
+            v[k] = (y + k + 0.5f - wallTop) * texelsPerRow;
+          }
+          sampleBilinear4(wallTextures, u, v, true, texels);
+        }
+        else
+        {
+          for (int k = 0; k < count; k++)
+          {
+            texels[k] = sampleNearest(*wallTexture, static_cast<int>(mappedPos), static_cast<int>((y + k + 0.5f - wallTop) * texelsPerRow));
+          }
+        }
+        if (decalTile != -1)
+        {
+          for (int k = 0; k < count; k++)
+          {
+            texels[k] = Decals::blend(texels[k], Decals::texel(decalTile, static_cast<int>(mappedPos), static_cast<int>((y + k + 0.5f - wallTop) * texelsPerRow)));
+          }
+        }
+        for (int k = 0; k < count; k++)
+        {
+          fillRowSpan(y + k, columnStart, columnEnd, texels[k] | 0xFF000000u);
+        }
+      }
     }
 
     float deg = -degToRad(rayAngle);
     float rayAngleFix = cos(degToRad(FixAngle(player.angle - rayAngle)));
-    float drawX = i * (1024 / (player.FOV));
-    float drawWidth = (1024 / (player.FOV)) * rayStep;
-    for (int y = rectangle.y + rectangle.h; y < 512; y += drawWidth / 1.5)
-    {
-      float dy = y - (512 / 2.0);
-      float textureX = player.pos.x / 2 + cos(deg) * 126 * 2 * 32 / dy / rayAngleFix;
-      float textureY = player.pos.y / 2 - sin(deg) * 126 * 2 * 32 / dy / rayAngleFix;
-      int textureType = mapFloors[(int)(textureY / 32.0) * mapX + (int)(textureX / 32.0)];
-      if (textureType != 0)
+    int floorStart = std::max(wallEnd, screenHeight / 2 + 1);
+    for (int y = floorStart; y < screenHeight; y += 4)
+    {
+      const Texture *floorTextures[4] = {nullptr, nullptr, nullptr, nullptr};
+      const Texture *ceilingTextures[4] = {nullptr, nullptr, nullptr, nullptr};
+      float u[4] = {0, 0, 0, 0};
+      float v[4] = {0, 0, 0, 0};
+      int count = std::min(4, screenHeight - y);
+      for (int k = 0; k < count; k++)
+      {
+        float dy = y + k - (512 / 2.0);
+        float textureX = player.pos.x / 2 + cos(deg) * 126 * 2 * 32 / dy / rayAngleFix;
+        float textureY = player.pos.y / 2 - sin(deg) * 126 * 2 * 32 / dy / rayAngleFix;
+        int cell = textureX < 0 || textureY < 0 ? -1 : getCell(static_cast<int>(textureX / 32.0), static_cast<int>(textureY / 32.0));
+        if (cell == -1)
+          continue;
+        u[k] = textureX;
+        v[k] = textureY;
+        int floorType = mapFloors[cell];
+        int ceilingType = mapCeiling[cell];
+        if (floorType >= 1 && floorType <= loadedTextures.size())
+          floorTextures[k] = &loadedTextures[floorType - 1];
+        if (ceilingType >= 1 && ceilingType <= loadedTextures.size())
+          ceilingTextures[k] = &loadedTextures[ceilingType - 1];
+      }
+
+      uint32_t floorTexels[4];
+      uint32_t ceilingTexels[4];
+      if (quality.bilinearFloors)
       {
-        uint8_t r, g, b;
-        getRGBFromTexture(textureType, (int)(textureX) % 32, (int)(textureY) % 32, r, g, b);
-        SDL_SetRenderDrawColor(renderer, r, g, b, 255);
-        SDL_FRect rectangle;
-        rectangle.x = drawX;
-        rectangle.h = drawWidth;
-        rectangle.y = y;
-        rectangle.w = drawWidth;
-        SDL_RenderFillRectF(renderer, &rectangle);
+        sampleBilinear4(floorTextures, u, v, true, floorTexels);
+        sampleBilinear4(ceilingTextures, u, v, true, ceilingTexels);
       }
-      textureX = player.pos.x / 2 + cos(deg) * 126 * 2 * 32 / dy / rayAngleFix;
-      textureY = player.pos.y / 2 - sin(deg) * 126 * 2 * 32 / dy / rayAngleFix;
-      textureType = mapCeiling[(int)(textureY / 32.0) * mapX + (int)(textureX / 32.0)];
-      if (textureType != 0)
+      else
+      {
+        for (int k = 0; k < count; k++)
+        {
+          if (floorTextures[k])
+            floorTexels[k] = sampleNearest(*floorTextures[k], static_cast<int>(u[k]) % 32, static_cast<int>(v[k]) % 32);
+          if (ceilingTextures[k])
+            ceilingTexels[k] = sampleNearest(*ceilingTextures[k], static_cast<int>(u[k]) % 32, static_cast<int>(v[k]) % 32);
+        }
+      }
+
+      for (int k = 0; k < count; k++)
       {
-        Uint8 r, g, b;
-        getRGBFromTexture(textureType, (int)(textureX) % 32, (int)(textureY) % 32, r, g, b);
-        SDL_SetRenderDrawColor(renderer, r, g, b, 255);
-        SDL_FRect rectangle;
-        rectangle.x = drawX;
-        rectangle.h = drawWidth;
-        rectangle.y = 512 - y;
-        rectangle.w = drawWidth;
-        SDL_RenderFillRectF(renderer, &rectangle);
+        if (floorTextures[k])
+          fillRowSpan(y + k, columnStart, columnEnd, floorTexels[k] | 0xFF000000u);
+        if (ceilingTextures[k])
+          fillRowSpan(screenHeight - 1 - (y + k), columnStart, columnEnd, ceilingTexels[k] | 0xFF000000u);
       }
     }
 
@@ -459,186 +715,491 @@ SDL_RenderDrawLine(renderer, player.pos.x, player.pos.y, rayX, rayY);
   }
 }
 
-void Game::handleSprites(SDL_Renderer *renderer)
+// Copies what this frame is drawn from while the simulation thread is parked, the next tick then runs on the
+// live world while the copy is drawn
+void Game::publishSnapshot()
 {
-  glm::vec2 playerPos(player.pos.x, player.pos.y);
-  std::sort(sprites.begin(), sprites.end(),
-            [playerPos](const Sprite &a, const Sprite &b)
-            {
-              return glm::distance(glm::vec2(a.x, a.y), playerPos) > glm::distance(glm::vec2(b.x, b.y), playerPos);
-            });
+  views.resize(players.size());
+  for (int p = 0; p < players.size(); p++)
+  {
+    views[p].player = players[p].player;
+    views[p].viewX = players[p].viewX;
+    views[p].viewWidth = players[p].viewWidth;
+  }
+  Snapshot::capture();
+}
 
-  for (int i = 0; i < sprites.size(); i++)
+// One tick of the world on the simulation thread. It only writes the live sprites, the sprite bins, the
+// projectile flights, the flow field, the timers and the shot queue; damage, money, sounds, spawns, decals and
+// map edits are left in the steps and shots for finishTick
+void Game::simulate()
+{
+  Timers::advance();
+  std::vector<int> playerCells;
+  for (const auto &local : players)
   {
-    if (sprites[i].type == Spike && sprites[i].active == false)
+    playerCells.push_back(getCell(floor(local.player.pos.x / cellWidth), floor(local.player.pos.y / cellWidth)));
+  }
+  FlowField::update(playerCells);
+  activateEnemies();
+  handleSprites();
+}
+
+// Back on the main thread once the tick is done
+void Game::finishTick()
+{
+  resolveSprites();
+  for (EntityHandle shooter : shots)
+  {
+    int i = sprites.resolve(shooter);
+    if (i != -1 && sprites[i].active != false)
     {
-      if (std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - sprites[i].enemyLastBulletTime.value()).count() > spikeTrapInterval)
-      {
-        sprites[i].active = true;
-        sprites[i].enemyLastBulletTime = std::chrono::high_resolution_clock::now();
-      }
+      handleShooterEnemy(i);
     }
+  }
+  shots.clear();
+  handleBoss();
+  SpriteBins::update();
+  Projectiles::collect();
+}
 
-    if (sprites[i].active == false)
+// Dormant enemies wake up once some player can see them, checked on the grid every tick so waking does not
+// depend on what got drawn
+void Game::activateEnemies()
+{
+  for (int i = 0; i < sprites.size(); i++)
+  {
+    if (!sprites.has(i, Hittable) || sprites.active[i].value == false || sprites.move[i].value == true)
       continue;
-
-    if (sprites[i].type == Spike)
+    for (const auto &local : players)
     {
-      if (std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - sprites[i].enemyLastBulletTime.value()).count() > spikeTrapInterval)
-      {
-        sprites[i].active = false;
-        sprites[i].enemyLastBulletTime = std::chrono::high_resolution_clock::now();
-      }
-
-      int cellIndexX = floor(sprites[i].x / cellWidth);
-      int cellIndexY = floor(sprites[i].y / cellWidth);
-      int playerCellIndexX = floor(player.pos.x / cellWidth);
-      int playerCellIndexY = floor(player.pos.y / cellWidth);
-      if (cellIndexX == playerCellIndexX && cellIndexY == playerCellIndexY && std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - sprites[i].enemyLastMeleeTime.value()).count() > 5000)
+      if (!canSee(local.player, sprites.x[i], sprites.y[i]))
+        continue;
+      sprites.move[i].value = true;
+      if (sprites.type[i] == ShooterEnemy)
       {
-        sprites[i].enemyLastMeleeTime = std::chrono::high_resolution_clock::now();
-        health -= 1;
+        // the first shot waits out what is left of the cooldown since the level was loaded
+        int sinceLoad = Timers::frameMs() - Timers::loadedAt;
+        scheduleShooter(sprites.handle(i), enemyShootingCooldown + 1 - sinceLoad);
       }
+      break;
     }
+  }
+}
 
-    if (sprites[i].type == Key)
+// Pickups are looked up in the sprite bins around each player instead of every pickup measuring its distance
+void Game::handlePickups()
+{
+  float pickupRadius = 15;
+  for (const auto &local : players)
+  {
+    const Player &player = local.player;
+    auto pickUp = [&](int i)
     {
-      float distance = sqrt(pow(sprites[i].x - player.pos.x, 2) + pow(sprites[i].y - player.pos.y, 2));
-      if (distance < 15)
+      if (sprites[i].active == false || (sprites[i].type != Key && sprites[i].type != Coin && sprites[i].type != GoldBar && sprites[i].type != Bomb))
+        return;
+      float deltaX = sprites[i].x - player.pos.x;
+      float deltaY = sprites[i].y - player.pos.y;
+      if (std::sqrt(deltaX * deltaX + deltaY * deltaY) >= pickupRadius)
+        return;
+
+      sprites[i].active = false;
+      if (sprites[i].type == Key)
       {
-        sprites[i].active = false;
         keyCount += 1;
       }
-    }
-
-    if (sprites[i].type == Coin)
-    {
-      float distance = sqrt(pow(sprites[i].x - player.pos.x, 2) + pow(sprites[i].y - player.pos.y, 2));
-      if (distance < 15)
+      if (sprites[i].type == Coin)
       {
         Mix_PlayChannel(-1, sounds.at(0), 0);
-        sprites[i].active = false;
         levelMoney += 5;
       }
-    }
-
-    if (sprites[i].type == GoldBar)
-    {
-      float distance = sqrt(pow(sprites[i].x - player.pos.x, 2) + pow(sprites[i].y - player.pos.y, 2));
-      if (distance < 15)
+      if (sprites[i].type == GoldBar)
       {
         Mix_PlayChannel(-1, sounds.at(0), 0);
-        sprites[i].active = false;
         levelMoney += 100;
       }
-    }
-
-    if (sprites[i].type == Bomb)
-    {
-      float distance = sqrt(pow(sprites[i].x - player.pos.x, 2) + pow(sprites[i].y - player.pos.y, 2));
-      if (distance < 15)
+      if (sprites[i].type == Bomb)
       {
-        sprites[i].active = false;
         bombCount += 1;
       }
-    }
+    };
+    SpriteBins::forEachNear(player.pos.x, player.pos.y, pickupRadius, pickUp);
+  }
+}
 
-    if (sprites[i].type == Bullet)
+// The tick runs in phases: everything moves, then everything tests what it touches against the moved positions,
+// then damage, rewards and deaths are applied. Moving and colliding run as parallel jobs over ranges of sprites
+// that only write their own sprite and step, so the result does not depend on how the ranges were scheduled.
+// Resolving and the boss, which spawns projectiles and opens doors, run from finishTick
+void Game::handleSprites()
+{
+  steps.assign(sprites.size(), {});
+  int chunkCount = (sprites.size() + simulationChunk - 1) / simulationChunk;
+  auto move = [&](int chunk)
+  {
+    int last = std::min<int>(sprites.size(), (chunk + 1) * simulationChunk);
+    for (int i = chunk * simulationChunk; i < last; i++)
     {
-      handleBullet(i);
-      if (sprites[i].active == false)
-        continue;
+      moveSprite(i);
     }
-
-    if (sprites[i].type == EnemyBullet)
+  };
+  Jobs::parallelFor(chunkCount, move);
+  // bullets look for enemies where they are now
+  for (int i = 0; i < sprites.size(); i++)
+  {
+    if (sprites.has(i, Hittable))
     {
-      handleEnemyBullet(i);
-      if (sprites[i].active == false)
-        continue;
+      SpriteBins::moved(i);
     }
+  }
 
-    if ((sprites[i].type == Enemy || sprites[i].type == ShooterEnemy || sprites[i].type == HammerEnemy || sprites[i].type == DroneEnemy) && sprites[i].move == true)
+  auto collide = [&](int chunk)
+  {
+    int last = std::min<int>(sprites.size(), (chunk + 1) * simulationChunk);
+    for (int i = chunk * simulationChunk; i < last; i++)
     {
-      handleEnemyMovement(i);
-      if (sprites[i].active == false)
-        continue;
+      collideSprite(i);
     }
+  };
+  Jobs::parallelFor(chunkCount, collide);
+}
 
-    if (sprites[i].type == Swat && sprites[i].move == true)
+void Game::handleBoss()
+{
+  bossHealth.reset();
+  for (int i = 0; i < sprites.size(); i++)
+  {
+    if (sprites[i].type == Swat && sprites[i].active == true && sprites[i].move == true)
     {
       handleSwatBoss(i);
+      SpriteBins::moved(i);
+      if (sprites[i].move == true)
+      {
+        bossHealth = sprites[i].health / BossValues::initialBossHealth;
+      }
     }
+  }
+}
 
-    if (sprites[i].type == ShooterEnemy && std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - sprites[i].enemyLastBulletTime.value()).count() > enemyShootingCooldown && sprites[i].move == true)
+void Game::moveSprite(int i)
+{
+  if (!sprites.has(i, Thinks) || sprites.active[i].value == false)
+    return;
+  SpriteType type = sprites.type[i];
+  if (type == Bullet || type == EnemyBullet)
+  {
+    moveBullet(i);
+  }
+  if ((type == Enemy || type == ShooterEnemy || type == HammerEnemy || type == DroneEnemy) && sprites.move[i].value == true)
+  {
+    handleEnemyMovement(i);
+  }
+}
+
+void Game::collideSprite(int i)
+{
+  if (!sprites.has(i, Thinks) || sprites.active[i].value == false)
+    return;
+  SpriteType type = sprites.type[i];
+  if (type == Bullet)
+  {
+    collideBullet(i);
+  }
+  if (type == EnemyBullet)
+  {
+    collideEnemyBullet(i);
+  }
+  if ((type == Enemy || type == ShooterEnemy || type == HammerEnemy || type == DroneEnemy) && sprites.move[i].value == true)
+  {
+    collideEnemy(i);
+  }
+}
+
+// Applies the steps in sprite order, then lets every awake enemy whose health ran out die
+void Game::resolveSprites()
+{
+  for (int i = 0; i < steps.size(); i++)
+  {
+    const SpriteStep &step = steps[i];
+    if (step.footsteps)
     {
-      handleShooterEnemy(i);
+      playFootsteps(i);
     }
+    if (step.playerDamage > 0)
+    {
+      damagePlayer(step.playerDamage);
+    }
+    if (step.meleeHit)
+    {
+      rearmMelee(sprites.handle(i));
+    }
+    if (step.hit != -1)
+    {
+      sprites.health[step.hit] -= gunDamage;
+    }
+    if (step.expired)
+    {
+      sprites[i].active = false;
+    }
+    else if (step.hitWall)
+    {
+      sprites[i].active = false;
+      float speed = std::sqrt(sprites.velocityX[i] * sprites.velocityX[i] + sprites.velocityY[i] * sprites.velocityY[i]);
+      float fov = sprites[i].type == Bullet ? players[0].player.FOV : nearestPlayer(sprites[i].x, sprites[i].y).FOV;
+      float u;
+      int face = Decals::wallImpact(step.fromX, step.fromY, sprites[i].x + sprites.velocityX[i] / speed, sprites[i].y + sprites.velocityY[i] / speed, u);
+      Decals::stamp(face, u, Decals::impactHeight(sprites[i].z, fov), Decals::BulletHole);
+    }
+  }
 
-    renderSprite(i);
-
-    if (sprites[i].type == Swat && sprites[i].move == true)
+  for (int i = 0; i < steps.size(); i++)
+  {
+    if (sprites[i].type == Swat || !sprites.has(i, Hittable) || !sprites.has(i, HasHealth) || sprites[i].active == false || sprites[i].move != true || sprites[i].health > 0)
+      continue;
+    if (sprites[i].type == Enemy)
     {
-      renderHealthBar(renderer, sprites[i].health.value() / BossValues::initialBossHealth, font);
+      levelMoney += 1;
     }
+    else if (sprites[i].type == ShooterEnemy || sprites[i].type == HammerEnemy)
+    {
+      levelMoney += 2;
+    }
+    else if (sprites[i].type == DroneEnemy)
+    {
+      levelMoney += 1;
+    }
+    sprites[i].active = false;
   }
 }
 
-void Game::renderSprite(int i)
+// footsteps are only started for enemies in a room some player can see into
+void Game::playFootsteps(int i)
 {
-  float spriteX = sprites[i].x - player.pos.x;
-  float spriteY = sprites[i].y - player.pos.y;
-  float spriteZ = sprites[i].z;
+  if (!sprites.has(i, HasSoundChannel))
+  {
+    sprites.soundChannel[i] = Mix_PlayChannel(-1, sounds.at(3), 0);
+    sprites.components[i] |= HasSoundChannel;
+  }
+  if (!Mix_Playing(sprites.soundChannel[i]))
+  {
+    sprites.soundChannel[i] = Mix_PlayChannel(-1, sounds.at(3), 0);
+  }
+}
 
-  float angleRad = -degToRad(player.angle);
-  float rotatedX = spriteY * cos(angleRad) + spriteX * sin(angleRad);
-  float rotatedY = spriteX * cos(angleRad) - spriteY * sin(angleRad);
+void Game::gatherSprites(LocalPlayer &view)
+{
+  // only sprites that land on this view get a sort key, the sprites themselves stay in simulation order
+  view.visibleSprites.clear();
+  view.sortKeys.clear();
+  auto add = [&](int i, float x, float y)
+  {
+    SpriteProjection projection;
+    if (!projectSprite(view, i, x, y, projection))
+      return;
+    // sprites behind the walls across their whole width are dropped with one lookup
+    if (projection.distance >= view.depthTree.maxDepth(projection.firstRay, projection.lastRay))
+      return;
+    projection.scaled = SpriteCache::lookup(loadedTextures, projection.textureIndex, projection.bottom - projection.top);
+
+    // positive floats order like their bit patterns, inverting them puts the farthest sprite first
+    uint32_t depthBits;
+    std::memcpy(&depthBits, &projection.distance, sizeof(depthBits));
+    view.sortKeys.push_back(static_cast<uint64_t>(~depthBits) << 32 | view.visibleSprites.size());
+    view.visibleSprites.push_back(projection);
+  };
+  auto consider = [&](const std::vector<int> &indices)
+  {
+    for (int i : indices)
+    {
+      const Snapshot::Entity &sprite = Snapshot::entities[i];
+      if (!sprite.trap)
+      {
+        add(i, sprite.x, sprite.y);
+        continue;
+      }
+      // a trap is drawn as instances of the same sprite around its centre
+      float first = -(spikeTrapGrid - 1) * spikeTrapSpacing / 2;
+      for (int gx = 0; gx < spikeTrapGrid; gx++)
+      {
+        for (int gy = 0; gy < spikeTrapGrid; gy++)
+        {
+          add(i, sprite.x + first + gx * spikeTrapSpacing, sprite.y + first + gy * spikeTrapSpacing);
+        }
+      }
+    }
+  };
 
-  if (rotatedY > 0)
+  // sprites can only show up in cells the rays crossed, neighbours are included for sprites poking over a cell edge
+  // unless the PVS says they are in a room this view cannot see into. Crossed cells are always visible
+  int playerCell = getCell(floor(view.player.pos.x / cellWidth), floor(view.player.pos.y / cellWidth));
+  consider(Snapshot::outside);
+  for (int cell : view.visitedCells)
   {
+    int cellX = cell % mapX;
+    int cellY = cell / mapX;
+    for (int y = cellY - 1; y <= cellY + 1; y++)
+    {
+      for (int x = cellX - 1; x <= cellX + 1; x++)
+      {
+        int neighbour = getCell(x, y);
+        if (neighbour == -1 || view.gatheredMarks[neighbour])
+          continue;
+        view.gatheredMarks[neighbour] = 1;
+        view.gatheredCells.push_back(neighbour);
+        if (view.visitedMarks[neighbour] || Pvs::visible(playerCell, neighbour))
+        {
+          consider(Snapshot::cells[neighbour]);
+        }
+      }
+    }
+  }
+  radixSortKeys(view.sortKeys, view.sortScratch);
 
-    float fovFactor = 512.0f / tan(degToRad(player.FOV / 2));
+  // every sorted sprite is listed in each strip it overlaps, so each strip keeps the back to front order
+  int stripCount = (view.viewWidth + spriteStripWidth - 1) / spriteStripWidth;
+  view.strips.resize(stripCount);
+  for (int s = 0; s < stripCount; s++)
+  {
+    view.strips[s].columnStart = view.viewX + s * spriteStripWidth;
+    view.strips[s].columnEnd = std::min(view.viewX + view.viewWidth, view.strips[s].columnStart + spriteStripWidth);
+    view.strips[s].sprites.clear();
+  }
+  for (uint64_t key : view.sortKeys)
+  {
+    int slot = static_cast<uint32_t>(key);
+    const SpriteProjection &projection = view.visibleSprites[slot];
+    int firstStrip = (projection.columnStart - view.viewX) / spriteStripWidth;
+    int lastStrip = (projection.columnEnd - 1 - view.viewX) / spriteStripWidth;
+    for (int s = firstStrip; s <= lastStrip; s++)
+    {
+      view.strips[s].sprites.push_back(slot);
+    }
+  }
+}
+
+// Draws the sprites of one strip, may run on a worker thread alongside the other strips
+void Game::renderStrip(const LocalPlayer &view, const SpriteStrip &strip)
+{
+  for (int slot : strip.sprites)
+  {
+    renderSprite(view, view.visibleSprites[slot], strip);
+  }
+}
 
-    float projectedX = (rotatedX * fovFactor / rotatedY) + (1024 / 2);
-    float projectedY = (spriteZ * fovFactor / rotatedY) + (512 / 2);
+// Works out where snapshot entity i drawn at (x, y) lands on this view, false when it is behind the camera or covers none of its columns
+bool Game::projectSprite(const LocalPlayer &view, int i, float x, float y, SpriteProjection &projection)
+{
+  const Player &player = view.player;
+  const Snapshot::Entity &sprite = Snapshot::entities[i];
+  float spriteX = x - player.pos.x;
+  float spriteY = y - player.pos.y;
+  float spriteZ = sprite.z;
 
-    float distance = sqrt(pow(spriteX, 2) + pow(spriteY, 2));
+  float angleRad = -degToRad(player.angle);
+  float rotatedX = spriteY * cos(angleRad) + spriteX * sin(angleRad);
+  float rotatedY = spriteX * cos(angleRad) - spriteY * sin(angleRad);
 
-    float preCalculatedWidth = ((1024 / (player.FOV)) * rayStep + (1024.f / distance)) * 0.45 * sprites[i].scaleX;
-    float preCalculatedHeight = ((1024 / (player.FOV)) * rayStep + (1024.f / distance)) * 0.45 * sprites[i].scaleX;
+  if (rotatedY <= 0)
+    return false;
+
+  float fovFactor = 512.0f / tan(degToRad(player.FOV / 2));
+
+  float projectedX = (rotatedX * fovFactor * view.viewWidth / 1024 / rotatedY) + view.viewX + view.viewWidth / 2;
+  float projectedY = (spriteZ * fovFactor / rotatedY) + (512 / 2);
+
+  float distance = sqrt(pow(spriteX, 2) + pow(spriteY, 2));
+
+  float preCalculatedWidth = ((view.viewWidth / (player.FOV)) * rayStep + (view.viewWidth / distance)) * 0.45 * sprite.scaleX;
+  float preCalculatedHeight = ((1024 / (player.FOV)) * rayStep + (1024.f / distance)) * 0.45 * sprite.scaleX;
+
+  int textureIndex = getSpriteTextureIndex(sprite.type);
+  const Texture &source = loadedTextures[textureIndex];
+
+  // the sprite covers one texel step per column/row, with the last column and row stretched to the full rect size
+  projection.index = i;
+  projection.textureIndex = textureIndex;
+  projection.distance = distance;
+  projection.left = projectedX - ((preCalculatedWidth * source.width) / 8);
+  projection.right = projection.left + ((source.width - 1) * (view.viewWidth / 4.0f * sprite.scaleX)) / distance + preCalculatedWidth;
+  projection.top = projectedY - ((source.height - 1) * (256 * sprite.scaleY)) / distance;
+  projection.bottom = projectedY + preCalculatedHeight;
+  projection.columnStart = std::max(view.viewX, static_cast<int>(std::ceil(projection.left)));
+  projection.columnEnd = std::min(view.viewX + view.viewWidth, static_cast<int>(std::ceil(projection.right)));
+  if (projection.columnStart >= projection.columnEnd)
+    return false;
+  projection.firstRay = rayForColumn(view, projection.columnStart);
+  projection.lastRay = rayForColumn(view, projection.columnEnd - 1);
+  return true;
+}
 
-    int textureIndex = getSpriteTextureIndex(sprites[i].type);
+void Game::renderSprite(const LocalPlayer &view, const SpriteProjection &projection, const SpriteStrip &strip)
+{
+  int textureIndex = projection.textureIndex;
+  float distance = projection.distance;
+  float left = projection.left;
+  float right = projection.right;
+  float top = projection.top;
+  float bottom = projection.bottom;
+  bool bilinear = qualityPresets[qualityPreset].bilinearSprites;
+
+  const SpriteCache::Image *scaled = projection.scaled;
+  const Texture &texture = scaled ? scaled->texture : loadedTextures[textureIndex];
+  const SpriteSpans::Columns &columns = scaled ? (bilinear ? scaled->filteredColumns : scaled->nearestColumns)
+                                               : (bilinear ? SpriteSpans::filteredColumns[textureIndex] : SpriteSpans::nearestColumns[textureIndex]);
+  const Texture *spriteTextures[4] = {&texture, &texture, &texture, &texture};
+  float texelsPerColumn = texture.width / (right - left);
+  float texelsPerRow = texture.height / (bottom - top);
+
+  int rowStart = std::max(0, static_cast<int>(std::ceil(top)));
+  int rowEnd = std::min(screenHeight, static_cast<int>(std::ceil(bottom)));
+  // in front of every wall it overlaps, so the per-column depth test can be skipped
+  bool unoccluded = distance < view.depthTree.minDepth(projection.firstRay, projection.lastRay);
+
+  int columnStart = std::max(projection.columnStart, strip.columnStart);
+  int columnEnd = std::min(projection.columnEnd, strip.columnEnd);
+  for (int x = columnStart; x < columnEnd; x++)
+  {
+    if (!unoccluded && distance >= view.distances[rayForColumn(view, x)])
+      continue;
 
-    for (int x = 0; x < loadedTextures[textureIndex].width; x++)
+    float u = (x + 0.5f - left) * texelsPerColumn;
+    int texelX = std::min(static_cast<int>(u), texture.width - 1);
+    // only the opaque runs of this texel column are visited, transparent texels cost nothing
+    for (int s = columns.offsets[texelX]; s < columns.offsets[texelX + 1]; s++)
     {
-      float recX = projectedX + ((x * (256 * sprites[i].scaleX)) / distance);
-
-      recX -= ((preCalculatedWidth * loadedTextures[textureIndex].width) / 8);
+      const SpriteSpans::Span &span = columns.spans[s];
+      int spanStart = std::max(rowStart, static_cast<int>(std::ceil(top + span.start / texelsPerRow - 0.5f)));
+      // a run reaching the bottom of the texture also covers the clamped rows past it
+      int spanEnd = span.end == texture.height ? rowEnd : std::min(rowEnd, static_cast<int>(std::ceil(top + span.end / texelsPerRow - 0.5f)));
 
-      if (static_cast<int>(glm::clamp((recX * (player.FOV / rayStep)) / 1024, 0.f, (player.FOV / rayStep))) - 1 >= 0 && static_cast<int>(glm::clamp((recX * (player.FOV / rayStep)) / 1024, 0.f, (player.FOV / rayStep))) - 1 <= (player.FOV / rayStep) && distance < distances.at(static_cast<int>(glm::clamp((recX * (player.FOV / rayStep)) / 1024, 0.f, (player.FOV / rayStep))) - 1))
+      if (!bilinear)
       {
-
-        if ((sprites[i].type == Enemy || sprites[i].type == ShooterEnemy || sprites[i].type == HammerEnemy || sprites[i].type == DroneEnemy || sprites[i].type == Swat) && sprites[i].move == false && recX < 1024)
+        for (int y = spanStart; y < spanEnd; y++)
         {
-          float deltaX = player.pos.x - sprites[i].x;
-          float deltaY = player.pos.y - sprites[i].y;
-
-          sprites[i].move = true;
+          int texelY = std::clamp(static_cast<int>((y + 0.5f - top) * texelsPerRow), static_cast<int>(span.start), span.end - 1);
+          frameBuffer[y * screenWidth + x] = texelAt(texture, texelX, texelY) | 0xFF000000u;
         }
+        continue;
+      }
 
-        for (int y = 0; y < loadedTextures[textureIndex].height; y++)
+      for (int y = spanStart; y < spanEnd; y += 4)
+      {
+        uint32_t texels[4];
+        int count = std::min(4, spanEnd - y);
+        float us[4] = {u, u, u, u};
+        float vs[4];
+        for (int k = 0; k < 4; k++)
         {
-          Uint8 r, g, b, a;
-          getRGBFromTexture(textureIndex + 1, x, loadedTextures[textureIndex].height - 1 - y, r, g, b, a);
+          vs[k] = (y + k + 0.5f - top) * texelsPerRow;
+        }
+        sampleBilinear4(spriteTextures, us, vs, false, texels);
 
-          SDL_SetRenderDrawColor(renderer, r, g, b, 255);
-          if (a != 0)
+        for (int k = 0; k < count; k++)
+        {
+          // filtered edges are alpha tested at half coverage
+          if ((texels[k] >> 24) >= 128)
           {
-            SDL_FRect rectangle;
-            rectangle.x = recX;
-            rectangle.y = projectedY - ((y * (256 * sprites[i].scaleY)) / distance);
-            rectangle.w = preCalculatedWidth;
-            rectangle.h = preCalculatedHeight;
-            SDL_RenderFillRectF(renderer, &rectangle);
+            frameBuffer[(y + k) * screenWidth + x] = texels[k] | 0xFF000000u;
           }
         }
       }
@@ -685,77 +1246,44 @@ int Game::getSpriteTextureIndex(SpriteType type)
 
 void Game::handleSwatBoss(int i)
 {
-  if (!sprites[i].soundChannel.has_value())
+  const Player &player = nearestPlayer(sprites[i].x, sprites[i].y);
+  if (playersMaySee(sprites[i].x, sprites[i].y))
   {
-    sprites[i].soundChannel = Mix_PlayChannel(-1, sounds.at(3), 0);
-  }
-  if (!Mix_Playing(sprites[i].soundChannel.value()))
-  {
-    sprites[i].soundChannel = Mix_PlayChannel(-1, sounds.at(3), 0);
+    playFootsteps(i);
   }
   if (sprites[i].health <= 0)
   {
     levelMoney += 100;
     sprites[i].active = false;
-    for (auto &tile : map)
+    std::vector<int> bossWalls = Tiles::cellsWith(20);
+    for (int cell : bossWalls)
     {
-      if (tile == 20)
-      {
-        tile = 0;
-      }
+      setTile(cell, 0);
     }
   }
 
-  if (sprites[i].health.value() / BossValues::initialBossHealth < 0.8 && BossValues::door1 == false)
+  if (sprites[i].health / BossValues::initialBossHealth < 0.8 && BossValues::door1 == false)
   {
     BossValues::door1 = true;
-    for (auto &tile : map)
-    {
-      if (tile == 7)
-      {
-        tile = 0;
-        break;
-      }
-    }
+    setTile(Tiles::firstCellWith(7), 0);
   }
 
-  if (sprites[i].health.value() / BossValues::initialBossHealth < 0.6 && BossValues::door2 == false)
+  if (sprites[i].health / BossValues::initialBossHealth < 0.6 && BossValues::door2 == false)
   {
     BossValues::door2 = true;
-    for (auto &tile : map)
-    {
-      if (tile == 7)
-      {
-        tile = 0;
-        break;
-      }
-    }
+    setTile(Tiles::firstCellWith(7), 0);
   }
 
-  if (sprites[i].health.value() / BossValues::initialBossHealth < 0.4 && BossValues::door3 == false)
+  if (sprites[i].health / BossValues::initialBossHealth < 0.4 && BossValues::door3 == false)
   {
     BossValues::door3 = true;
-    for (auto &tile : map)
-    {
-      if (tile == 7)
-      {
-        tile = 0;
-        break;
-      }
-    }
+    setTile(Tiles::firstCellWith(7), 0);
   }
 
-  if (sprites[i].health.value() / BossValues::initialBossHealth < 0.2 && BossValues::door4 == false)
+  if (sprites[i].health / BossValues::initialBossHealth < 0.2 && BossValues::door4 == false)
   {
     BossValues::door4 = true;
-    for (auto &tile : map)
-    {
-      if (tile == 7)
-      {
-        tile = 0;
-        break;
-      }
-    }
+    setTile(Tiles::firstCellWith(7), 0);
   }
 
   float deltaX = player.pos.x - sprites[i].x;
@@ -764,11 +1292,15 @@ void Game::handleSwatBoss(int i)
   float distance = std::sqrt(deltaX * deltaX + deltaY * deltaY);
   deltaX /= distance;
   deltaY /= distance;
+  // charges and strafes along the flow field, shots below still aim straight at the player
+  FlowField::steer(sprites[i].x, sprites[i].y, deltaX, deltaY);
 
-  if (std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - BossValues::bigAttackTimer).count() > BossValues::bigAttackTime)
+  if (BossValues::bigAttackDue)
   {
-    BossValues::bigAttackTimer = std::chrono::high_resolution_clock::now();
-    sprites[i].enemyLastBulletTime = std::chrono::high_resolution_clock::now();
+    // the regular volley waits a full cooldown after a big attack
+    BossValues::bigAttackDue = false;
+    BossValues::volleyDue = false;
+    scheduleBossVolley(sprites.handle(i), BossValues::shootingCooldown + 1);
 
     float deltaX = player.pos.x - sprites[i].x;
     float deltaY = player.pos.y - sprites[i].y;
@@ -784,18 +1316,14 @@ void Game::handleSwatBoss(int i)
     bullet.scaleY = 0.75;
     bullet.z = 7;
     bullet.direction = angle;
-    sprites.emplace_back(bullet);
-    for (int i = 0; i < 360; i += 8)
-    {
-      bullet.direction = angle + i;
-      sprites.emplace_back(bullet);
-    }
+    Projectiles::spawn(bullet);
+    Projectiles::fan(bullet, 0, 8, 45);
     Mix_PlayChannel(-1, sounds.at(1), 0);
   }
 
-  if (std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - sprites[i].enemyLastBulletTime.value()).count() > BossValues::shootingCooldown)
+  if (BossValues::volleyDue)
   {
-    sprites[i].enemyLastBulletTime = std::chrono::high_resolution_clock::now();
+    BossValues::volleyDue = false;
 
     std::mt19937 gen(rd());
 
@@ -816,67 +1344,24 @@ void Game::handleSwatBoss(int i)
     bullet.scaleX = 0.75;
     bullet.scaleY = 0.75;
     bullet.z = 7;
+    bullet.direction = angle;
     if (randomNumber == 0)
     {
-      bullet.direction = angle;
-      sprites.emplace_back(bullet);
-
-      bullet.direction = angle + 10;
-      sprites.emplace_back(bullet);
-
-      bullet.direction = angle - 10;
-      sprites.emplace_back(bullet);
-
-      bullet.direction = angle + 20;
-      sprites.emplace_back(bullet);
-
-      bullet.direction = angle - 20;
-      sprites.emplace_back(bullet);
+      Projectiles::burst(bullet, {0, 10, -10, 20, -20});
     }
     else
     {
-
-      bullet.direction = angle + 5;
-      sprites.emplace_back(bullet);
-
-      bullet.direction = angle - 5;
-      sprites.emplace_back(bullet);
-
-      bullet.direction = angle + 15;
-      sprites.emplace_back(bullet);
-
-      bullet.direction = angle - 15;
-      sprites.emplace_back(bullet);
-
-      bullet.direction = angle + 25;
-      sprites.emplace_back(bullet);
-
-      bullet.direction = angle - 25;
-      sprites.emplace_back(bullet);
+      Projectiles::burst(bullet, {5, -5, 15, -15, 25, -25});
     }
     Mix_PlayChannel(-1, sounds.at(1), 0);
   }
 
-  if (std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - BossValues::strafingTimer).count() > BossValues::strafingTime)
-  {
-    BossValues::strafeDir = BossValues::strafeDir == 0 ? 1 : 0;
-    BossValues::strafingTimer = std::chrono::high_resolution_clock::now();
-    BossValues::strafingTime = BossValues::generateStrafingTime();
-  }
-
-  if (std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - BossValues::chargeTimer).count() > BossValues::chargeTime)
+  if (BossValues::charging)
   {
-    BossValues::chargeDurationTimer = std::chrono::high_resolution_clock::now();
-    BossValues::chargeTimer = std::chrono::high_resolution_clock::now();
-    BossValues::chargeTime = BossValues::generateChargeTime();
-  }
-
-  if (std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - BossValues::chargeDurationTimer).count() < BossValues::chargeDuration)
-  {
-    if (distance < 15 && std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - sprites[i].enemyLastMeleeTime.value()).count() > enemyMeleeCooldown)
+    if (distance < 15 && sprites[i].meleeReady)
     {
-      sprites[i].enemyLastMeleeTime = std::chrono::high_resolution_clock::now();
-      health -= 25;
+      rearmMelee(sprites.handle(i));
+      damagePlayer(25);
     }
 
     float chargeSpeed = 750;
@@ -924,9 +1409,9 @@ void Game::handleSwatBoss(int i)
   {
     sprites[i].x = newX;
   }
-  else if (BossValues::chargeTime > 100)
+  else
   {
-    BossValues::chargeTime = 100;
+    hurryBossCharge(sprites.handle(i));
   }
 
   cellIndexX = floor(sprites[i].x / cellWidth);
@@ -937,166 +1422,159 @@ void Game::handleSwatBoss(int i)
   {
     sprites[i].y = newY;
   }
-  else if (BossValues::chargeTime > 100)
+  else
   {
-    BossValues::chargeTime = 100;
+    hurryBossCharge(sprites.handle(i));
   }
 }
 
-void Game::handleEnemyBullet(int i)
+// Bullets sweep the whole segment they cover in a tick, so long frames cannot carry them through a target.
+// The segment stops at the wall found when the bullet was fired, which is where it dies
+void Game::moveBullet(int i)
 {
-  float bulletSpeed = 300;
-  float dx = bulletSpeed * cos(degToRad(sprites[i].direction.value())) * deltaTime;
-  float dy = bulletSpeed * sin(degToRad(sprites[i].direction.value())) * deltaTime;
-  sprites[i].x += dx;
-  sprites[i].y += dy;
-  float deltaX = player.pos.x - sprites[i].x;
-  float deltaY = player.pos.y - sprites[i].y;
-  float distance = std::sqrt(deltaX * deltaX + deltaY * deltaY);
-  if (distance < 10)
-  {
-    health -= 1;
-    sprites[i].active = false;
-  }
-
-  int cellIndexX = floor(sprites[i].x / cellWidth);
-  int cellIndexY = floor(sprites[i].y / cellWidth);
-
-  int mapCellIndex = getCell(cellIndexX, cellIndexY);
-
-  if (map[mapCellIndex] != 0)
-  {
-    sprites[i].active = false;
-  }
+  float clearance = Projectiles::clearance(i);
+  float flight = std::min(deltaTime, clearance);
+  steps[i].fromX = sprites.x[i];
+  steps[i].fromY = sprites.y[i];
+  Projectiles::fly(i, flight);
+  steps[i].hitWall = flight == clearance;
 }
 
-void Game::handleBullet(int i)
+void Game::collideEnemyBullet(int i)
 {
-
-  float bulletSpeed = 300;
-  float dx = bulletSpeed * cos(degToRad(sprites[i].direction.value())) * deltaTime;
-  float dy = bulletSpeed * sin(degToRad(sprites[i].direction.value())) * deltaTime;
-  sprites[i].x += dx;
-  sprites[i].y += dy;
-  for (auto &sprite : sprites)
+  SpriteStep &step = steps[i];
+  float hitRadius = 10;
+  for (const auto &local : players)
   {
-
-    if ((sprite.type != Enemy && sprite.type != ShooterEnemy && sprite.type != HammerEnemy && sprite.type != DroneEnemy && sprite.type != Swat) || sprite.active == false)
-      continue;
-
-    float deltaX = sprite.x - sprites[i].x;
-    float deltaY = sprite.y - sprites[i].y;
-    float distance = std::sqrt(deltaX * deltaX + deltaY * deltaY);
-    if (distance < 10)
+    if (sweepHit(step.fromX, step.fromY, sprites.x[i], sprites.y[i], local.player.pos.x, local.player.pos.y, hitRadius) >= 0)
     {
-      sprites[i].active = false;
-      sprite.health = sprite.health.value() - gunDamage;
-      break;
+      step.playerDamage = 1;
+      step.expired = true;
+      return;
     }
   }
+}
 
-  int cellIndexX = floor(sprites[i].x / cellWidth);
-  int cellIndexY = floor(sprites[i].y / cellWidth);
-
-  int mapCellIndex = getCell(cellIndexX, cellIndexY);
-
-  if (map[mapCellIndex] != 0)
-  {
-    sprites[i].active = false;
-  }
+void Game::collideBullet(int i)
+{
+  SpriteStep &step = steps[i];
+  // only enemies binned around the segment are tested, the one it reaches first is hit, ties go to the lowest index
+  float hitRadius = 10;
+  float hitAt = 2;
+  auto test = [&](int j)
+  {
+    if (!sprites.has(j, Hittable) || sprites.active[j].value == false)
+      return;
+    float at = sweepHit(step.fromX, step.fromY, sprites.x[i], sprites.y[i], sprites.x[j], sprites.y[j], hitRadius);
+    if (at >= 0 && (at < hitAt || (at == hitAt && j < step.hit)))
+    {
+      step.hit = j;
+      hitAt = at;
+    }
+  };
+  float deltaX = sprites.x[i] - step.fromX;
+  float deltaY = sprites.y[i] - step.fromY;
+  float travel = std::sqrt(deltaX * deltaX + deltaY * deltaY);
+  SpriteBins::forEachNear(step.fromX + deltaX / 2, step.fromY + deltaY / 2, travel / 2 + hitRadius, test);
+  step.expired = step.hit != -1;
 }
 
 void Game::handleEnemyMovement(int i)
 {
-  if (!sprites[i].soundChannel.has_value())
-  {
-    sprites[i].soundChannel = Mix_PlayChannel(-1, sounds.at(3), 0);
-  }
-  if (!Mix_Playing(sprites[i].soundChannel.value()))
-  {
-    sprites[i].soundChannel = Mix_PlayChannel(-1, sounds.at(3), 0);
-  }
-  if (sprites[i].health <= 0)
-  {
-    if (sprites[i].type == Enemy)
-    {
-      levelMoney += 1;
-    }
-    else if (sprites[i].type == ShooterEnemy || sprites[i].type == HammerEnemy)
-    {
-      levelMoney += 2;
-    }
-    else if (sprites[i].type == DroneEnemy)
-    {
-      levelMoney += 1;
-    }
-    sprites[i].active = false;
-  }
+  float &x = sprites.x[i];
+  float &y = sprites.y[i];
+  const Player &player = nearestPlayer(x, y);
+  steps[i].footsteps = playersMaySee(x, y);
 
-  float deltaX = player.pos.x - sprites[i].x;
-  float deltaY = player.pos.y - sprites[i].y;
+  float deltaX = player.pos.x - x;
+  float deltaY = player.pos.y - y;
 
   float distance = std::sqrt(deltaX * deltaX + deltaY * deltaY);
-  if (distance < 10)
-  {
-    if (sprites[i].type == DroneEnemy)
-    {
-      sprites[i].active = false;
-      health -= 5;
-    }
-    else if (std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - sprites[i].enemyLastMeleeTime.value()).count() > enemyMeleeCooldown && sprites[i].type != HammerEnemy)
-    {
-      sprites[i].enemyLastMeleeTime = std::chrono::high_resolution_clock::now();
-      health -= 5;
-    }
-    else if (std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - sprites[i].enemyLastMeleeTime.value()).count() > hammerEnemyMeleeCooldown && sprites[i].type == HammerEnemy)
-    {
-      sprites[i].enemyLastMeleeTime = std::chrono::high_resolution_clock::now();
-      health -= 25;
-    }
-  }
-
   if (distance > 0)
   {
     deltaX /= distance;
     deltaY /= distance;
+    // around walls the shared flow field knows the way, in the player's cell they walk straight at them
+    FlowField::steer(x, y, deltaX, deltaY);
 
     float enemySpeed = 35;
-    if (sprites[i].type == HammerEnemy)
+    if (sprites.type[i] == HammerEnemy)
     {
       enemySpeed = 20;
     }
-    if (sprites[i].type == DroneEnemy)
+    if (sprites.type[i] == DroneEnemy)
     {
       enemySpeed = 120;
     }
-    float newX = sprites[i].x + deltaX * enemySpeed * deltaTime;
-    float newY = sprites[i].y + deltaY * enemySpeed * deltaTime;
+    sprites.velocityX[i] = deltaX * enemySpeed;
+    sprites.velocityY[i] = deltaY * enemySpeed;
+    float newX = x + sprites.velocityX[i] * deltaTime;
+    float newY = y + sprites.velocityY[i] * deltaTime;
 
     int cellIndexX = floor(newX / cellWidth);
-    int cellIndexY = floor(sprites[i].y / cellWidth);
+    int cellIndexY = floor(y / cellWidth);
     int mapCellIndexX = getCell(cellIndexX, cellIndexY);
 
     if (map[mapCellIndexX] == 0)
     {
-      sprites[i].x = newX;
+      x = newX;
     }
 
-    cellIndexX = floor(sprites[i].x / cellWidth);
+    cellIndexX = floor(x / cellWidth);
     cellIndexY = floor(newY / cellWidth);
     int mapCellIndexY = getCell(cellIndexX, cellIndexY);
 
     if (map[mapCellIndexY] == 0)
     {
-      sprites[i].y = newY;
+      y = newY;
     }
   }
 }
 
-void Game::handleShooterEnemy(int i)
+// melee against the nearest player once everyone has moved, drones blow up on contact
+void Game::collideEnemy(int i)
+{
+  SpriteStep &step = steps[i];
+  const Player &player = nearestPlayer(sprites.x[i], sprites.y[i]);
+  float deltaX = player.pos.x - sprites.x[i];
+  float deltaY = player.pos.y - sprites.y[i];
+
+  float distance = std::sqrt(deltaX * deltaX + deltaY * deltaY);
+  if (distance < 10)
+  {
+    if (sprites.type[i] == DroneEnemy)
+    {
+      step.expired = true;
+      step.playerDamage = 5;
+    }
+    else if (sprites.meleeReady[i].value)
+    {
+      // the cooldown is scheduled in resolveSprites, the timer wheel is not shared with the other jobs
+      sprites.meleeReady[i].value = false;
+      step.meleeHit = true;
+      step.playerDamage = sprites.type[i] == HammerEnemy ? 25 : 5;
+    }
+  }
+}
+
+// Awake shooter enemies fire from the timer wheel every enemyShootingCooldown until they die. The wheel runs on
+// the simulation thread, so the shot itself is queued for finishTick
+void Game::scheduleShooter(EntityHandle shooter, int delayMs)
 {
-  sprites[i].enemyLastBulletTime = std::chrono::high_resolution_clock::now();
+  auto fire = [this, shooter]()
+  {
+    int i = sprites.resolve(shooter);
+    if (i == -1 || sprites[i].active == false)
+      return;
+    shots.push_back(shooter);
+    scheduleShooter(shooter, enemyShootingCooldown + 1);
+  };
+  Timers::schedule(delayMs, fire);
+}
 
+void Game::handleShooterEnemy(int i)
+{
+  const Player &player = nearestPlayer(sprites[i].x, sprites[i].y);
   float deltaX = player.pos.x - sprites[i].x;
   float deltaY = player.pos.y - sprites[i].y;
 
@@ -1111,16 +1589,17 @@ void Game::handleShooterEnemy(int i)
   bullet.scaleY = 0.5;
   bullet.z = 7;
   bullet.direction = angle;
-  sprites.emplace_back(bullet);
+  Projectiles::spawn(bullet);
   Mix_PlayChannel(-1, sounds.at(1), 0);
 }
 
-void Game::shootBullet()
+void Game::shootBullet(LocalPlayer &local)
 {
-  if (gunType == Pistol && std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - lastBulletTime).count() > pistolShootingCooldown && spacePressed == false)
+  const Player &player = local.player;
+  if (gunType == Pistol && std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - local.lastBulletTime).count() > pistolShootingCooldown && local.shootPressed == false)
   {
-    spacePressed = true;
-    lastBulletTime = std::chrono::high_resolution_clock::now();
+    local.shootPressed = true;
+    local.lastBulletTime = currentTime;
 
     Sprite bullet;
     bullet.active = true;
@@ -1131,14 +1610,14 @@ void Game::shootBullet()
     bullet.scaleY = 0.5;
     bullet.z = 7;
     bullet.direction = player.angle;
-    sprites.emplace_back(bullet);
+    Projectiles::spawn(bullet);
 
     Mix_PlayChannel(-1, sounds.at(1), 0);
   }
-  else if (gunType == Shotgun && std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - lastBulletTime).count() > shotgunShootingCooldown && spacePressed == false)
+  else if (gunType == Shotgun && std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - local.lastBulletTime).count() > shotgunShootingCooldown && local.shootPressed == false)
   {
-    spacePressed = true;
-    lastBulletTime = std::chrono::high_resolution_clock::now();
+    local.shootPressed = true;
+    local.lastBulletTime = currentTime;
 
     Sprite bullet;
     bullet.active = true;
@@ -1149,28 +1628,17 @@ void Game::shootBullet()
     bullet.scaleY = 0.5;
     bullet.z = 7;
     bullet.direction = player.angle;
-    sprites.emplace_back(bullet);
-
-    bullet.direction = player.angle + 10;
-    sprites.emplace_back(bullet);
-
-    bullet.direction = player.angle - 10;
-    sprites.emplace_back(bullet);
-
+    Projectiles::burst(bullet, {0, 10, -10});
     if (playerData.shotgunUpgraded)
     {
-      bullet.direction = player.angle + 5;
-      sprites.emplace_back(bullet);
-
-      bullet.direction = player.angle - 5;
-      sprites.emplace_back(bullet);
+      Projectiles::burst(bullet, {5, -5});
     }
 
     Mix_PlayChannel(-1, sounds.at(1), 0);
   }
-  else if (gunType == Minigun && std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - lastBulletTime).count() > minigunShootingCooldown)
+  else if (gunType == Minigun && std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - local.lastBulletTime).count() > minigunShootingCooldown)
   {
-    lastBulletTime = std::chrono::high_resolution_clock::now();
+    local.lastBulletTime = currentTime;
 
     std::mt19937 gen(rd());
 
@@ -1187,7 +1655,7 @@ void Game::shootBullet()
     bullet.scaleY = 0.25;
     bullet.z = 7;
     bullet.direction = player.angle + randomNum;
-    sprites.emplace_back(bullet);
+    Projectiles::spawn(bullet);
 
     Mix_PlayChannel(-1, sounds.at(1), 0);
   }
@@ -1196,16 +1664,117 @@ void Game::shootBullet()
 void Game::handleInput()
 {
   const Uint8 *keystate = SDL_GetKeyboardState(NULL);
-  if (keystate[SDL_SCANCODE_SPACE])
+  for (auto &local : players)
+  {
+    handlePlayerInput(local, keystate);
+  }
+
+  if (keyToggled(keystate, SDL_SCANCODE_F2, coopKeyPressed))
+  {
+    setCoop(players.size() == 1);
+  }
+
+  if (keyToggled(keystate, SDL_SCANCODE_F1, qualityKeyPressed))
+  {
+    qualityPreset = (qualityPreset + 1) % (sizeof(qualityPresets) / sizeof(qualityPresets[0]));
+    std::cout << "Quality preset: " << qualityPresets[qualityPreset].name << std::endl;
+  }
+
+  if (keyToggled(keystate, SDL_SCANCODE_F3, FrameStats::keyPressed))
+  {
+    FrameStats::enabled = !FrameStats::enabled;
+    FrameStats::frames = 0;
+    FrameStats::simMs = 0;
+    FrameStats::renderMs = 0;
+    FrameStats::frameMs = 0;
+  }
+
+  if (keyToggled(keystate, SDL_SCANCODE_M, Minimap::keyPressed))
   {
-    shootBullet();
+    Minimap::mode = (Minimap::mode + 1) % 3;
+  }
+
+  if (keyToggled(keystate, SDL_SCANCODE_F4, PostProcess::colorBlindKeyPressed))
+  {
+    PostProcess::colorBlindMode = (PostProcess::colorBlindMode + 1) % 4;
+    PostProcess::buildColorMatrix();
+    std::cout << "Colour-blind filter: " << PostProcess::colorBlindModeNames[PostProcess::colorBlindMode] << std::endl;
+  }
+
+  if (keyToggled(keystate, SDL_SCANCODE_F5, PostProcess::brightnessKeyPressed))
+  {
+    PostProcess::brightnessLevel = (PostProcess::brightnessLevel + 1) % 4;
+    std::cout << "Brightness: " << PostProcess::brightnessLevels[PostProcess::brightnessLevel] << std::endl;
+  }
+
+  if (keyToggled(keystate, SDL_SCANCODE_F6, PostProcess::gammaKeyPressed))
+  {
+    PostProcess::gammaLevel = (PostProcess::gammaLevel + 1) % 4;
+    PostProcess::buildGammaTable();
+    std::cout << "Gamma: " << PostProcess::gammaLevels[PostProcess::gammaLevel] << std::endl;
+  }
+
+  if (keystate[SDL_SCANCODE_1])
+  {
+    gunType = Pistol;
+    gunDamage = 5;
+  }
+  if (keystate[SDL_SCANCODE_2] && playerData.shotgunUnlocked)
+  {
+    gunType = Shotgun;
+    gunDamage = 5;
+  }
+  if (keystate[SDL_SCANCODE_3] && playerData.minigunUnlocked)
+  {
+    gunType = Minigun;
+    gunDamage = 1 + playerData.minigunUpgraded;
+  }
+}
+
+// Only the cells the players stand in are looked up in the trigger index built when the level was loaded
+void Game::handleTriggers()
+{
+  for (const auto &local : players)
+  {
+    int cell = getCell(floor(local.player.pos.x / cellWidth), floor(local.player.pos.y / cellWidth));
+    if (Triggers::at(cell) == Triggers::Stairs)
+    {
+      sprites.clear();
+      map.clear();
+      mapCeiling.clear();
+      mapFloors.clear();
+      deserialize("map11.dat");
+      deserializeSprites("sprites11.dat");
+      resetPlayers();
+      health = 100;
+      return;
+    }
+    for (EntityHandle spike : Triggers::spikesAt(cell))
+    {
+      int i = sprites.resolve(spike);
+      if (i == -1 || sprites[i].active == false || sprites[i].meleeReady == false)
+        continue;
+      rearmMelee(spike);
+      // every spike of a trap hits
+      damagePlayer(sprites[i].trap ? spikeTrapGrid * spikeTrapGrid : 1);
+    }
+  }
+}
+
+void Game::handlePlayerInput(LocalPlayer &local, const Uint8 *keystate)
+{
+  Player &player = local.player;
+  const InputBindings &keys = local.bindings;
+  if (keystate[keys.shoot])
+  {
+    shootBullet(local);
   }
   else
   {
-    spacePressed = false;
+    local.shootPressed = false;
   }
 
-  if (keystate[SDL_SCANCODE_W] || keystate[SDL_SCANCODE_S] || keystate[SDL_SCANCODE_Q] || keystate[SDL_SCANCODE_E] || keystate[SDL_SCANCODE_LEFT] || keystate[SDL_SCANCODE_RIGHT])
+  if (keystate[keys.forward] || keystate[keys.back] || keystate[keys.strafeLeft] || keystate[keys.strafeRight] || keystate[keys.strafeLeftAlt] || keystate[keys.strafeRightAlt])
   {
     if (playerStepChannel == -1)
     {
@@ -1217,7 +1786,7 @@ void Game::handleInput()
     }
   }
 
-  if (keystate[SDL_SCANCODE_LSHIFT])
+  if (keystate[keys.slowTurn])
   {
     rotateSpeed = rotateSpeedSlow;
   }
@@ -1226,7 +1795,7 @@ void Game::handleInput()
     rotateSpeed = rotateSpeedFast;
   }
 
-  if (keystate[SDL_SCANCODE_W])
+  if (keystate[keys.forward])
   {
     int cellIndexX = floor(((player.pos.x + (moveSpeed * cos(degToRad(player.angle)) * deltaTime)) * 1.0) / cellWidth);
     int cellIndexY = floor(((player.pos.y + (moveSpeed * sin(degToRad(player.angle)) * deltaTime)) * 1.0) / cellWidth);
@@ -1240,7 +1809,7 @@ void Game::handleInput()
     }
   }
 
-  if (keystate[SDL_SCANCODE_S])
+  if (keystate[keys.back])
   {
     int cellIndexX = floor(((player.pos.x - (moveSpeed * cos(degToRad(player.angle)) * 1.1 * deltaTime))) / cellWidth);
     int cellIndexY = floor(((player.pos.y - (moveSpeed * sin(degToRad(player.angle)) * 1.1 * deltaTime))) / cellWidth);
@@ -1253,16 +1822,16 @@ void Game::handleInput()
     }
   }
 
-  if (keystate[SDL_SCANCODE_A])
+  if (keystate[keys.turnLeft])
   {
     player.angle -= rotateSpeed * deltaTime;
   }
-  if (keystate[SDL_SCANCODE_D])
+  if (keystate[keys.turnRight])
   {
     player.angle += rotateSpeed * deltaTime;
   }
 
-  if (keystate[SDL_SCANCODE_LEFT] || keystate[SDL_SCANCODE_Q])
+  if (keystate[keys.strafeLeft] || keystate[keys.strafeLeftAlt])
   {
     int cellIndexX = floor(((player.pos.x + ((moveSpeed / 1.4) * cos(degToRad(player.angle - 90)) * deltaTime)) * 1.0) / cellWidth);
     int cellIndexY = floor(((player.pos.y + ((moveSpeed / 1.4) * sin(degToRad(player.angle - 90)) * deltaTime)) * 1.0) / cellWidth);
@@ -1275,7 +1844,7 @@ void Game::handleInput()
       player.pos.y += (moveSpeed / 1.5) * sin(degToRad(player.angle - 90)) * deltaTime;
     }
   }
-  if (keystate[SDL_SCANCODE_RIGHT] || keystate[SDL_SCANCODE_E])
+  if (keystate[keys.strafeRight] || keystate[keys.strafeRightAlt])
   {
     int cellIndexX = floor(((player.pos.x - ((moveSpeed / 1.4) * cos(degToRad(player.angle - 90)) * 1.1 * deltaTime))) / cellWidth);
     int cellIndexY = floor(((player.pos.y - ((moveSpeed / 1.4) * sin(degToRad(player.angle - 90)) * 1.1 * deltaTime))) / cellWidth);
@@ -1288,23 +1857,7 @@ void Game::handleInput()
     }
   }
 
-  if (keystate[SDL_SCANCODE_1])
-  {
-    gunType = Pistol;
-    gunDamage = 5;
-  }
-  if (keystate[SDL_SCANCODE_2] && playerData.shotgunUnlocked)
-  {
-    gunType = Shotgun;
-    gunDamage = 5;
-  }
-  if (keystate[SDL_SCANCODE_3] && playerData.minigunUnlocked)
-  {
-    gunType = Minigun;
-    gunDamage = 1 + playerData.minigunUpgraded;
-  }
-
-  if (keystate[SDL_SCANCODE_F])
+  if (keystate[keys.use])
   {
 
     int cellIndexX = floor(((player.pos.x + (moveSpeed * cos(degToRad(player.angle)) * 4 * deltaTime))) / cellWidth);
@@ -1314,17 +1867,18 @@ void Game::handleInput()
 
     if (map[mapCellIndex] == 5)
     {
-      map[mapCellIndex] = 0;
+      setTile(mapCellIndex, 0);
     }
     if ((map[mapCellIndex] == 9 || map[mapCellIndex] == 12) && bombCount > 0)
     {
       Mix_PlayChannel(-1, sounds.at(2), 0);
-      map[mapCellIndex] = 0;
+      setTile(mapCellIndex, 0);
       bombCount -= 1;
+      scorchAround(cellIndexX, cellIndexY);
     }
     if (map[mapCellIndex] == 7 && keyCount > 0)
     {
-      map[mapCellIndex] = 0;
+      setTile(mapCellIndex, 0);
       keyCount -= 1;
     }
     if (map[mapCellIndex] == 17)
@@ -1338,29 +1892,6 @@ void Game::handleInput()
       serializePlayer("save.dat");
     }
   }
-
-  for (int x = 0; x < mapX; x++)
-  {
-    for (int y = 0; y < mapY; y++)
-    {
-      if (mapFloors[getCell(x, y)] == 19)
-      {
-        int playerCellIndexX = floor(player.pos.x / cellWidth);
-        int playerCellIndexY = floor(player.pos.y / cellWidth);
-        if (x == playerCellIndexX && y == playerCellIndexY)
-        {
-          sprites.clear();
-          map.clear();
-          mapCeiling.clear();
-          mapFloors.clear();
-          deserialize("map11.dat");
-          deserializeSprites("sprites11.dat");
-          player = {{80.0f, 80.0f}, 0.0f, 60};
-          health = 100;
-        }
-      }
-    }
-  }
 }
 
 void Game::displayMainMenu(SDL_Renderer *renderer, TTF_Font *font,
@@ -1390,7 +1921,7 @@ void Game::displayMainMenu(SDL_Renderer *renderer, TTF_Font *font,
       mapFloors.clear();
       deserialize("map.dat");
       deserializeSprites("sprites.dat");
-      player = {{80.0f, 80.0f}, 0.0f, 60};
+      resetPlayers();
       levelMoney = 0;
       health = 100;
       bombCount = 0;
@@ -1406,7 +1937,7 @@ void Game::displayMainMenu(SDL_Renderer *renderer, TTF_Font *font,
       mapFloors.clear();
       deserialize("map2.dat");
       deserializeSprites("sprites2.dat");
-      player = {{80.0f, 80.0f}, 0.0f, 60};
+      resetPlayers();
       levelMoney = 0;
       health = 100;
       bombCount = 0;
@@ -1422,7 +1953,7 @@ void Game::displayMainMenu(SDL_Renderer *renderer, TTF_Font *font,
       mapFloors.clear();
       deserialize("map3.dat");
       deserializeSprites("sprites3.dat");
-      player = {{80.0f, 80.0f}, 0.0f, 60};
+      resetPlayers();
       levelMoney = 0;
       health = 100;
       bombCount = 0;
@@ -1438,7 +1969,7 @@ void Game::displayMainMenu(SDL_Renderer *renderer, TTF_Font *font,
       mapFloors.clear();
       deserialize("map4.dat");
       deserializeSprites("sprites4.dat");
-      player = {{80.0f, 80.0f}, 0.0f, 60};
+      resetPlayers();
       levelMoney = 0;
       health = 100;
       bombCount = 0;
@@ -1454,7 +1985,7 @@ void Game::displayMainMenu(SDL_Renderer *renderer, TTF_Font *font,
       mapFloors.clear();
       deserialize("map5.dat");
       deserializeSprites("sprites5.dat");
-      player = {{80.0f, 80.0f}, 0.0f, 60};
+      resetPlayers();
       levelMoney = 0;
       health = 100;
       bombCount = 0;
@@ -1470,7 +2001,7 @@ void Game::displayMainMenu(SDL_Renderer *renderer, TTF_Font *font,
       mapFloors.clear();
       deserialize("map6.dat");
       deserializeSprites("sprites6.dat");
-      player = {{80.0f, 80.0f}, 0.0f, 60};
+      resetPlayers();
       levelMoney = 0;
       health = 100;
       bombCount = 0;
@@ -1486,7 +2017,7 @@ void Game::displayMainMenu(SDL_Renderer *renderer, TTF_Font *font,
       mapFloors.clear();
       deserialize("map7.dat");
       deserializeSprites("sprites7.dat");
-      player = {{80.0f, 80.0f}, 0.0f, 60};
+      resetPlayers();
       levelMoney = 0;
       health = 100;
       bombCount = 0;
@@ -1502,7 +2033,7 @@ void Game::displayMainMenu(SDL_Renderer *renderer, TTF_Font *font,
       mapFloors.clear();
       deserialize("map8.dat");
       deserializeSprites("sprites8.dat");
-      player = {{80.0f, 80.0f}, 0.0f, 60};
+      resetPlayers();
       levelMoney = 0;
       health = 100;
       bombCount = 0;
@@ -1518,7 +2049,7 @@ void Game::displayMainMenu(SDL_Renderer *renderer, TTF_Font *font,
       mapFloors.clear();
       deserialize("map9.dat");
       deserializeSprites("sprites9.dat");
-      player = {{80.0f, 80.0f}, 0.0f, 60};
+      resetPlayers();
       levelMoney = 0;
       health = 100;
       bombCount = 0;
@@ -1534,7 +2065,7 @@ void Game::displayMainMenu(SDL_Renderer *renderer, TTF_Font *font,
       mapFloors.clear();
       deserialize("map10.dat");
       deserializeSprites("sprites10.dat");
-      player = {{80.0f, 80.0f}, 0.0f, 60};
+      resetPlayers();
       levelMoney = 0;
       health = 100;
       bombCount = 0;
@@ -5,6 +5,7 @@
 #include <SDL2/SDL_image.h>
 #include "types.h"
 #include <random>
+#include <vector>
 
 class Game
 {
@@ -13,11 +14,14 @@ public:
   void run();
 
 private:
-  Player player;
+  std::vector<LocalPlayer> players;
+  // what the frame is drawn from: the players' cameras as of the last snapshot, with the per-view render buffers
+  std::vector<LocalPlayer> views;
   SDL_Window *window;
   SDL_Renderer *renderer;
   SDL_Color healthTextColor = {155, 25, 25, 255};
   SDL_Color coinTextColor = {255, 255, 25, 255};
+  SDL_Texture *frameTexture;
   SDL_Texture *background;
   SDL_Texture *crosshair;
   SDL_Texture *pistol;
@@ -28,23 +32,52 @@ private:
 
   TTF_Font *font;
 
+  std::optional<float> bossHealth;
+  std::vector<SpriteStep> steps;
+  // shooters whose timer fired during the tick, they shoot from finishTick on the main thread
+  std::vector<EntityHandle> shots;
+
   void initSDL();
   SDL_Window *initWindow();
   SDL_Renderer *initRenderer(SDL_Window *window);
   void initIcon(SDL_Window *window);
-  void raycast(SDL_Renderer *renderer);
+  void resetPlayers();
+  void setCoop(bool enabled);
+  const Player &nearestPlayer(float x, float y);
+  bool playersMaySee(float x, float y);
+
+  void renderView(LocalPlayer &view);
+  void raycast(LocalPlayer &view);
+  void gatherSprites(LocalPlayer &view);
+  void renderStrip(const LocalPlayer &view, const SpriteStrip &strip);
+  bool projectSprite(const LocalPlayer &view, int i, float x, float y, SpriteProjection &projection);
 
-  void handleSprites(SDL_Renderer *renderer);
+  void publishSnapshot();
+  void simulate();
+  void finishTick();
+  void activateEnemies();
+  void handleSprites();
+  void handleBoss();
+  void handlePickups();
+  void handleTriggers();
   int getSpriteTextureIndex(SpriteType type);
-  void handleEnemyBullet(int i);
-  void handleBullet(int i);
+  void moveSprite(int i);
+  void collideSprite(int i);
+  void resolveSprites();
+  void playFootsteps(int i);
+  void moveBullet(int i);
+  void collideBullet(int i);
+  void collideEnemyBullet(int i);
   void handleEnemyMovement(int i);
+  void collideEnemy(int i);
   void handleShooterEnemy(int i);
+  void scheduleShooter(EntityHandle shooter, int delayMs);
   void handleSwatBoss(int i);
-  void renderSprite(int i);
+  void renderSprite(const LocalPlayer &view, const SpriteProjection &projection, const SpriteStrip &strip);
 
-  void shootBullet();
+  void shootBullet(LocalPlayer &local);
   void handleInput();
+  void handlePlayerInput(LocalPlayer &local, const Uint8 *keystate);
   void displayMainMenu(SDL_Renderer *renderer, TTF_Font *font,
                        SDL_Texture *background, SDL_Texture *titleText, SDL_Rect titleRect);
   void displayShop(SDL_Renderer *renderer, TTF_Font *font, SDL_Texture *pistol, SDL_Texture *shotgun,
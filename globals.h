@@ -2,6 +2,8 @@
 #include "types.h"
 #include <vector>
 #include <random>
+#include <iostream>
+#include <cstdint>
 std::vector<Texture> loadedTextures;
 float deltaTime;
 
@@ -49,7 +51,41 @@ bool gameRunning = true;
 
 std::random_device rd;
 
-std::vector<float> distances;
+const InputBindings playerOneBindings = {SDL_SCANCODE_W, SDL_SCANCODE_S, SDL_SCANCODE_A, SDL_SCANCODE_D, SDL_SCANCODE_Q, SDL_SCANCODE_E,
+                                         SDL_SCANCODE_LEFT, SDL_SCANCODE_RIGHT, SDL_SCANCODE_SPACE, SDL_SCANCODE_F, SDL_SCANCODE_LSHIFT};
+const InputBindings playerTwoBindings = {SDL_SCANCODE_I, SDL_SCANCODE_K, SDL_SCANCODE_J, SDL_SCANCODE_L, SDL_SCANCODE_U, SDL_SCANCODE_O,
+                                         SDL_SCANCODE_UNKNOWN, SDL_SCANCODE_UNKNOWN, SDL_SCANCODE_H, SDL_SCANCODE_Y, SDL_SCANCODE_RSHIFT};
+bool coopKeyPressed = false;
+
+const int screenWidth = 1024;
+const int screenHeight = 512;
+std::vector<uint32_t> frameBuffer(screenWidth * screenHeight);
+// sprites are drawn in vertical strips of this many columns, one strip per job
+const int spriteStripWidth = 64;
+
+enum QualityPreset
+{
+    QualityLow,
+    QualityMedium,
+    QualityHigh
+};
+
+struct QualitySettings
+{
+    const char *name;
+    bool bilinearWalls;
+    bool bilinearFloors;
+    bool bilinearSprites;
+};
+
+const QualitySettings qualityPresets[] = {
+    {"Low", false, false, false},
+    {"Medium", true, false, false},
+    {"High", true, true, true},
+};
+
+int qualityPreset = QualityLow;
+bool qualityKeyPressed = false;
 
 int mapX;
 int mapY;
@@ -59,6 +95,8 @@ int maxDepth;
 std::vector<int> map;
 std::vector<int> mapFloors;
 std::vector<int> mapCeiling;
+// bumped whenever a tile of map changes, anything derived from map keeps the revision it was built at
+int mapRevision = 0;
 
 int health = 100;
 int levelMoney = 0;
@@ -68,25 +106,34 @@ int bombCount = 0;
 int keyCount = 0;
 int enemyShootingCooldown = 500;
 int enemyMeleeCooldown = 1000;
+// dormant enemies further than this from every player stay asleep even in plain sight, 0 for no limit
+float enemyActivationRadius = 0;
 int hammerEnemyMeleeCooldown = 2000;
 int spikeTrapInterval = 2500;
+// a spike hurts a player standing on it at most this often
+int spikeCooldown = 5000;
+// a spike trap tile is one sprite drawn as a grid of spikes this far apart
+const int spikeTrapGrid = 3;
+const float spikeTrapSpacing = 16;
 int pistolShootingCooldown = 500;
 int shotgunShootingCooldown = 1000;
 int minigunShootingCooldown = 75;
-std::chrono::_V2::system_clock::time_point lastBulletTime = std::chrono::high_resolution_clock::now();
 int gunDamage = 5;
+// units per second, the same for the player's and the enemies' bullets
+float bulletSpeed = 300;
 int gunType = Pistol;
-bool spacePressed = false;
 
 PlayerData playerData;
 
-std::vector<Sprite> sprites;
+EntityStore sprites;
+// the parallel phases of the simulation hand out sprites to jobs in ranges of this many
+const int simulationChunk = 256;
 std::vector<Mix_Chunk *> sounds;
 int playerStepChannel = -1;
 int musicChannel = -1;
 
-std::chrono::_V2::system_clock::time_point currentTime = std::chrono::high_resolution_clock::now();
-std::chrono::_V2::system_clock::time_point lastTime = std::chrono::high_resolution_clock::now();
+std::chrono::steady_clock::time_point currentTime = std::chrono::steady_clock::now();
+std::chrono::steady_clock::time_point lastTime = std::chrono::steady_clock::now();
 
 namespace BossValues
 {
@@ -102,8 +149,6 @@ namespace BossValues
         return randomNum + 5000;
     }
 
-    std::chrono::_V2::system_clock::time_point strafingTimer = std::chrono::high_resolution_clock::now();
-    int strafingTime = generateStrafingTime();
     int strafeDir = 0;
 
     int generateChargeTime()
@@ -115,22 +160,57 @@ namespace BossValues
         float randomNum = dist(gen);
         return randomNum + 5000;
     }
-    std::chrono::_V2::system_clock::time_point chargeTimer = std::chrono::high_resolution_clock::now();
-    int chargeTime = generateChargeTime();
-    std::chrono::_V2::system_clock::time_point chargeDurationTimer = std::chrono::high_resolution_clock::now();
     int chargeDuration = 150;
+    // a charge follows this soon after the last one once the boss runs into a wall
+    int hurriedChargeTime = 100;
 
     int shootingCooldown = 2000;
 
-    std::chrono::_V2::system_clock::time_point bigAttackTimer = std::chrono::high_resolution_clock::now();
     int bigAttackTime = 10000;
 
+    // Set from the timer wheel and acted on by the boss. Scheduling a volley or a charge bumps its round,
+    // which cancels the one still pending
+    bool volleyDue = false;
+    bool bigAttackDue = false;
+    bool charging = false;
+    bool chargeHurried = false;
+    int volleyRound = 0;
+    int chargeRound = 0;
+    int chargeCount = 0;
+    uint64_t chargeStartedMs = 0;
+
     bool door1 = false;
     bool door2 = false;
     bool door3 = false;
     bool door4 = false;
 }
 
+namespace FrameStats
+{
+    bool enabled = false;
+    bool keyPressed = false;
+    const int reportInterval = 120;
+    int frames = 0;
+    float simMs = 0;
+    float renderMs = 0;
+    float frameMs = 0;
+
+    void report()
+    {
+        frames++;
+        if (frames < reportInterval)
+        {
+            return;
+        }
+        std::cout << "[" << qualityPresets[qualityPreset].name << "] sim: " << simMs / frames
+                  << " ms, render: " << renderMs / frames << " ms, frame: " << frameMs / frames << " ms" << std::endl;
+        frames = 0;
+        simMs = 0;
+        renderMs = 0;
+        frameMs = 0;
+    }
+}
+
 namespace Achievements
 {
     bool beatenAllLevels = false;
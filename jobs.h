@@ -0,0 +1,137 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+
+namespace Jobs
+{
+    // One parallelFor call. It lives on the caller's stack and is open while it is in the list below
+    struct Batch
+    {
+        const std::function<void(int)> *task;
+        int count;
+        std::atomic<int> nextIndex{0};
+        int busyWorkers = 0;
+
+        bool hasWork() const
+        {
+            return nextIndex < count;
+        }
+    };
+
+    // workers are started on first use and sleep while no open batch has work left, the calling thread always takes
+    // part in its own batch. The sim and render threads each open one, and the workers spread over both
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    std::vector<Batch *> open;
+    bool stopping = false;
+
+    void runIndices(Batch &batch)
+    {
+        for (int i = batch.nextIndex++; i < batch.count; i = batch.nextIndex++)
+        {
+            (*batch.task)(i);
+        }
+    }
+
+    // the open batch with work left and the fewest workers on it, nullptr if there is none
+    Batch *pickBatch()
+    {
+        Batch *picked = nullptr;
+        for (Batch *batch : open)
+        {
+            if (batch->hasWork() && (!picked || batch->busyWorkers < picked->busyWorkers))
+            {
+                picked = batch;
+            }
+        }
+        return picked;
+    }
+
+    void workerLoop()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            Batch *batch = nullptr;
+            wake.wait(lock, [&]
+                      { return stopping || (batch = pickBatch()) != nullptr; });
+            if (stopping)
+                return;
+
+            // the owner closes its batch under the lock and then waits for busyWorkers, so it stays alive until here
+            batch->busyWorkers++;
+            lock.unlock();
+            runIndices(*batch);
+            lock.lock();
+            if (--batch->busyWorkers == 0)
+            {
+                finished.notify_all();
+            }
+        }
+    }
+
+    void start()
+    {
+        // both the sim and the render thread may be first
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!workers.empty())
+            return;
+        int count = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 1);
+        for (int i = 0; i < count; i++)
+        {
+            workers.emplace_back(workerLoop);
+        }
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto &worker : workers)
+        {
+            worker.join();
+        }
+        workers.clear();
+        stopping = false;
+    }
+
+    // Calls fn(0) .. fn(count - 1) spread over the workers and returns once every call has finished. Batches from
+    // different threads run at the same time
+    void parallelFor(int count, const std::function<void(int)> &fn)
+    {
+        if (count <= 1)
+        {
+            for (int i = 0; i < count; i++)
+            {
+                fn(i);
+            }
+            return;
+        }
+
+        start();
+        Batch batch;
+        batch.task = &fn;
+        batch.count = count;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            open.push_back(&batch);
+        }
+        wake.notify_all();
+        runIndices(batch);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        open.erase(std::find(open.begin(), open.end(), &batch));
+        finished.wait(lock, [&]
+                      { return batch.busyWorkers == 0; });
+    }
+}
@@ -0,0 +1,228 @@
+#pragma once
+#include "globals.h"
+#include "simd.h"
+#include "snapshot.h"
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+namespace Minimap
+{
+    enum Mode
+    {
+        Hidden,
+        Corner,
+        Full
+    };
+
+    int mode = Hidden;
+    bool keyPressed = false;
+
+    // one texel per map cell, the texture is only touched where cells changed since the last frame
+    SDL_Texture *texture = nullptr;
+    int textureWidth = 0;
+    int textureHeight = 0;
+    std::vector<uint32_t> pixels;
+    std::vector<uint8_t> revealed;
+    std::vector<int> dirtyCells;
+    std::vector<uint8_t> dirty;
+    std::vector<uint32_t> textureColors;
+
+    uint32_t averageColor(const Texture &tex)
+    {
+        uint64_t sum[3] = {0, 0, 0};
+        int count = tex.width * tex.height;
+        for (int i = 0; i < count; i++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                sum[c] += tex.data[i * 4 + c];
+            }
+        }
+        return 0xFF000000u | static_cast<uint32_t>(sum[2] / count) << 16 | static_cast<uint32_t>(sum[1] / count) << 8 | static_cast<uint32_t>(sum[0] / count);
+    }
+
+    void markDirty(int cell)
+    {
+        if (cell < 0 || cell >= dirty.size() || dirty[cell])
+            return;
+        dirty[cell] = 1;
+        dirtyCells.push_back(cell);
+    }
+
+    void reveal(int cell)
+    {
+        if (cell < 0 || cell >= revealed.size() || revealed[cell])
+            return;
+        revealed[cell] = 1;
+        markDirty(cell);
+    }
+
+    bool isRevealed(int cell)
+    {
+        return cell < 0 || cell >= revealed.size() || revealed[cell];
+    }
+
+    void reset()
+    {
+        revealed.assign(mapX * mapY, 0);
+        dirty.assign(mapX * mapY, 0);
+        dirtyCells.clear();
+        pixels.assign(mapX * mapY, 0);
+        // the texture still holds the last level, force a full upload even when the size matches
+        textureWidth = 0;
+    }
+
+    uint32_t cellColor(int cell)
+    {
+        if (!revealed[cell])
+        {
+            return 0;
+        }
+
+        int tile = map[cell];
+        if (tile == 5 || tile == 7 || tile == 20)
+        {
+            return 0xFF2080FFu;
+        }
+        if (tile == 17)
+        {
+            return 0xFF20FF20u;
+        }
+        if (tile != 0)
+        {
+            return tile <= textureColors.size() ? textureColors[tile - 1] : 0xFFFFFFFFu;
+        }
+        if (mapFloors[cell] == 19)
+        {
+            return 0xFF20FFFFu;
+        }
+        if (mapFloors[cell] >= 1 && mapFloors[cell] <= textureColors.size())
+        {
+            // floors are drawn darker than walls so the layout reads at a glance
+            uint32_t color = textureColors[mapFloors[cell] - 1];
+            return 0xFF000000u | ((color >> 2) & 0x003F3F3Fu);
+        }
+        return 0xFF303030u;
+    }
+
+    void update(SDL_Renderer *renderer)
+    {
+        if (textureColors.empty())
+        {
+            for (const auto &tex : loadedTextures)
+            {
+                textureColors.push_back(averageColor(tex));
+            }
+        }
+
+        if (!texture || textureWidth != mapX || textureHeight != mapY)
+        {
+            if (texture)
+            {
+                SDL_DestroyTexture(texture);
+            }
+            texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, mapX, mapY);
+            SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+            textureWidth = mapX;
+            textureHeight = mapY;
+            for (int cell = 0; cell < mapX * mapY; cell++)
+            {
+                pixels[cell] = cellColor(cell);
+            }
+            SDL_UpdateTexture(texture, NULL, pixels.data(), mapX * sizeof(uint32_t));
+            for (int cell : dirtyCells)
+            {
+                dirty[cell] = 0;
+            }
+            dirtyCells.clear();
+            return;
+        }
+
+        if (dirtyCells.empty())
+        {
+            return;
+        }
+
+        int minX = mapX, minY = mapY, maxX = -1, maxY = -1;
+        for (int cell : dirtyCells)
+        {
+            int x = cell % mapX;
+            int y = cell / mapX;
+            pixels[cell] = cellColor(cell);
+            dirty[cell] = 0;
+            minX = std::min(minX, x);
+            maxX = std::max(maxX, x);
+            minY = std::min(minY, y);
+            maxY = std::max(maxY, y);
+        }
+        dirtyCells.clear();
+
+        SDL_Rect rect = {minX, minY, maxX - minX + 1, maxY - minY + 1};
+        SDL_UpdateTexture(texture, &rect, pixels.data() + minY * mapX + minX, mapX * sizeof(uint32_t));
+    }
+
+    void render(SDL_Renderer *renderer, const std::vector<LocalPlayer> &players)
+    {
+        if (mode == Hidden || mapX == 0 || mapY == 0)
+        {
+            return;
+        }
+        update(renderer);
+
+        int size = mode == Corner ? 160 : 448;
+        float scale = static_cast<float>(size) / std::max(mapX, mapY);
+        SDL_Rect rect;
+        rect.w = static_cast<int>(mapX * scale);
+        rect.h = static_cast<int>(mapY * scale);
+        rect.x = mode == Corner ? 1024 - rect.w - 20 : (1024 - rect.w) / 2;
+        rect.y = mode == Corner ? 60 : (512 - rect.h) / 2;
+
+        SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 150);
+        SDL_RenderFillRect(renderer, &rect);
+        SDL_RenderCopy(renderer, texture, NULL, &rect);
+
+        float unitsToPixels = scale / cellWidth;
+        int markerSize = std::max(2, static_cast<int>(scale / 4));
+        std::vector<SDL_Rect> enemyMarkers;
+        std::vector<SDL_Rect> pickupMarkers;
+        for (const Snapshot::Entity &sprite : Snapshot::entities)
+        {
+            if (sprite.type == Bullet || sprite.type == EnemyBullet || sprite.type == Spike)
+                continue;
+            int cellX = static_cast<int>(sprite.x / cellWidth);
+            int cellY = static_cast<int>(sprite.y / cellWidth);
+            if (cellX < 0 || cellX >= mapX || cellY < 0 || cellY >= mapY || !revealed[cellY * mapX + cellX])
+                continue;
+
+            SDL_Rect marker = {rect.x + static_cast<int>(sprite.x * unitsToPixels) - markerSize / 2, rect.y + static_cast<int>(sprite.y * unitsToPixels) - markerSize / 2, markerSize, markerSize};
+            if (sprite.type == Enemy || sprite.type == ShooterEnemy || sprite.type == HammerEnemy || sprite.type == DroneEnemy || sprite.type == Swat)
+            {
+                enemyMarkers.push_back(marker);
+            }
+            else
+            {
+                pickupMarkers.push_back(marker);
+            }
+        }
+
+        SDL_SetRenderDrawColor(renderer, 230, 30, 30, 255);
+        SDL_RenderFillRects(renderer, enemyMarkers.data(), enemyMarkers.size());
+        SDL_SetRenderDrawColor(renderer, 255, 220, 40, 255);
+        SDL_RenderFillRects(renderer, pickupMarkers.data(), pickupMarkers.size());
+
+        const SDL_Color playerColors[] = {{40, 255, 40, 255}, {40, 200, 255, 255}};
+        for (int p = 0; p < players.size(); p++)
+        {
+            const Player &player = players[p].player;
+            int playerX = rect.x + static_cast<int>(player.pos.x * unitsToPixels);
+            int playerY = rect.y + static_cast<int>(player.pos.y * unitsToPixels);
+            SDL_Rect playerMarker = {playerX - markerSize, playerY - markerSize, markerSize * 2, markerSize * 2};
+            const SDL_Color &color = playerColors[p % 2];
+            SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
+            SDL_RenderFillRect(renderer, &playerMarker);
+            SDL_RenderDrawLine(renderer, playerX, playerY, playerX + static_cast<int>(cos(player.angle * M_PI / 180) * markerSize * 3), playerY + static_cast<int>(sin(player.angle * M_PI / 180) * markerSize * 3));
+        }
+    }
+}
@@ -0,0 +1,220 @@
+#pragma once
+#include "globals.h"
+#include "simd.h"
+#include <cmath>
+#include <cstdint>
+
+namespace PostProcess
+{
+    enum ColorBlindMode
+    {
+        ColorBlindOff,
+        Protanopia,
+        Deuteranopia,
+        Tritanopia
+    };
+
+    const char *colorBlindModeNames[] = {"Off", "Protanopia", "Deuteranopia", "Tritanopia"};
+    const float brightnessLevels[] = {1.0f, 1.15f, 1.3f, 0.85f};
+    const float gammaLevels[] = {1.0f, 1.2f, 1.4f, 0.8f};
+
+    int colorBlindMode = ColorBlindOff;
+    int brightnessLevel = 0;
+    int gammaLevel = 0;
+    bool colorBlindKeyPressed = false;
+    bool brightnessKeyPressed = false;
+    bool gammaKeyPressed = false;
+
+    const int flashDuration = 250;
+    const int lowHealthThreshold = 40;
+
+    std::optional<std::chrono::steady_clock::time_point> lastDamageTime;
+
+    std::vector<uint8_t> vignetteMask;
+    uint8_t gammaTable[256];
+    float colorMatrix[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+
+    void buildVignetteMask()
+    {
+        vignetteMask.resize(screenWidth * screenHeight);
+        for (int y = 0; y < screenHeight; y++)
+        {
+            for (int x = 0; x < screenWidth; x++)
+            {
+                float dx = (x - screenWidth / 2.0f) / (screenWidth / 2.0f);
+                float dy = (y - screenHeight / 2.0f) / (screenHeight / 2.0f);
+                float edge = std::clamp((std::sqrt(dx * dx + dy * dy) - 0.45f) / 0.75f, 0.0f, 1.0f);
+                vignetteMask[y * screenWidth + x] = static_cast<uint8_t>(edge * edge * 255);
+            }
+        }
+    }
+
+    void buildGammaTable()
+    {
+        float gamma = gammaLevels[gammaLevel];
+        for (int i = 0; i < 256; i++)
+        {
+            gammaTable[i] = static_cast<uint8_t>(std::round(255 * std::pow(i / 255.0f, 1.0f / gamma)));
+        }
+    }
+
+    // daltonization: shift the colour information a dichromat loses (original - simulated) into channels they can still see.
+    // correction = I + shift * (I - simulate), folded into one matrix so the pass stays a single multiply.
+    void buildColorMatrix()
+    {
+        const float simulate[3][9] = {
+            {0.567f, 0.433f, 0, 0.558f, 0.442f, 0, 0, 0.242f, 0.758f},
+            {0.625f, 0.375f, 0, 0.7f, 0.3f, 0, 0, 0.3f, 0.7f},
+            {0.95f, 0.05f, 0, 0, 0.433f, 0.567f, 0, 0.475f, 0.525f},
+        };
+        const float shift[9] = {0, 0, 0, 0.7f, 1, 0, 0.7f, 0, 1};
+
+        for (int i = 0; i < 9; i++)
+        {
+            colorMatrix[i] = i % 4 == 0 ? 1.0f : 0.0f;
+        }
+        if (colorBlindMode == ColorBlindOff)
+        {
+            return;
+        }
+
+        const float *sim = simulate[colorBlindMode - 1];
+        float error[9];
+        for (int i = 0; i < 9; i++)
+        {
+            error[i] = (i % 4 == 0 ? 1.0f : 0.0f) - sim[i];
+        }
+        for (int row = 0; row < 3; row++)
+        {
+            for (int col = 0; col < 3; col++)
+            {
+                float sum = 0;
+                for (int k = 0; k < 3; k++)
+                {
+                    sum += shift[row * 3 + k] * error[k * 3 + col];
+                }
+                colorMatrix[row * 3 + col] += sum;
+            }
+        }
+    }
+
+    void init()
+    {
+        buildVignetteMask();
+        buildGammaTable();
+        buildColorMatrix();
+    }
+
+    // Runs every enabled effect in one sweep over the framebuffer, four pixels per iteration
+    void apply(std::chrono::steady_clock::time_point now, int playerHealth)
+    {
+        float flash = 0;
+        if (lastDamageTime.has_value())
+        {
+            float elapsed = std::chrono::duration<float, std::milli>(now - lastDamageTime.value()).count();
+            flash = std::max(0.0f, 1.0f - elapsed / flashDuration) * 0.5f;
+        }
+        float vignette = playerHealth < lowHealthThreshold ? static_cast<float>(lowHealthThreshold - std::max(playerHealth, 0)) / lowHealthThreshold : 0;
+        float brightness = brightnessLevels[brightnessLevel];
+        bool gamma = gammaLevels[gammaLevel] != 1.0f;
+
+        if (flash == 0 && vignette == 0 && brightness == 1.0f && !gamma && colorBlindMode == ColorBlindOff)
+        {
+            return;
+        }
+
+        // vignette darkens towards the edges but keeps some red so low health reads as a red rim
+        float vignetteScale = vignette * 0.85f / 255;
+        float vignetteRedScale = vignette * 0.45f / 255;
+        const float *m = colorMatrix;
+        uint32_t *pixels = frameBuffer.data();
+        const uint8_t *mask = vignetteMask.data();
+        int count = screenWidth * screenHeight;
+
+#ifdef USE_SSE2
+        const __m128i byteMask = _mm_set1_epi32(0xFF);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 max = _mm_set1_ps(255.0f);
+        const __m128 flashKeep = _mm_set1_ps(1.0f - flash);
+        const __m128 flashRed = _mm_set1_ps(flash * 255.0f);
+        for (int i = 0; i < count; i += 4)
+        {
+            __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels + i));
+            __m128 r = _mm_cvtepi32_ps(_mm_and_si128(px, byteMask));
+            __m128 g = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px, 8), byteMask));
+            __m128 b = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px, 16), byteMask));
+
+            if (colorBlindMode != ColorBlindOff)
+            {
+                __m128 nr = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(m[0])), _mm_mul_ps(g, _mm_set1_ps(m[1]))), _mm_mul_ps(b, _mm_set1_ps(m[2])));
+                __m128 ng = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(m[3])), _mm_mul_ps(g, _mm_set1_ps(m[4]))), _mm_mul_ps(b, _mm_set1_ps(m[5])));
+                __m128 nb = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(m[6])), _mm_mul_ps(g, _mm_set1_ps(m[7]))), _mm_mul_ps(b, _mm_set1_ps(m[8])));
+                r = nr;
+                g = ng;
+                b = nb;
+            }
+
+            __m128 scale = _mm_set1_ps(brightness);
+            __m128 redScale = scale;
+            if (vignette > 0)
+            {
+                uint32_t maskBytes;
+                std::memcpy(&maskBytes, mask + i, sizeof(maskBytes));
+                __m128i maskWide = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(maskBytes), _mm_setzero_si128()), _mm_setzero_si128());
+                __m128 edge = _mm_cvtepi32_ps(maskWide);
+                redScale = _mm_mul_ps(scale, _mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(edge, _mm_set1_ps(vignetteRedScale))));
+                scale = _mm_mul_ps(scale, _mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(edge, _mm_set1_ps(vignetteScale))));
+            }
+            r = _mm_mul_ps(r, redScale);
+            g = _mm_mul_ps(g, scale);
+            b = _mm_mul_ps(b, scale);
+
+            if (flash > 0)
+            {
+                r = _mm_add_ps(_mm_mul_ps(r, flashKeep), flashRed);
+                g = _mm_mul_ps(g, flashKeep);
+                b = _mm_mul_ps(b, flashKeep);
+            }
+
+            __m128i ri = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(r, zero), max));
+            __m128i gi = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(g, zero), max));
+            __m128i bi = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(b, zero), max));
+
+            if (gamma)
+            {
+                alignas(16) int32_t rs[4], gs[4], bs[4];
+                _mm_store_si128(reinterpret_cast<__m128i *>(rs), ri);
+                _mm_store_si128(reinterpret_cast<__m128i *>(gs), gi);
+                _mm_store_si128(reinterpret_cast<__m128i *>(bs), bi);
+                for (int k = 0; k < 4; k++)
+                {
+                    pixels[i + k] = 0xFF000000u | (static_cast<uint32_t>(gammaTable[bs[k]]) << 16) | (static_cast<uint32_t>(gammaTable[gs[k]]) << 8) | gammaTable[rs[k]];
+                }
+                continue;
+            }
+
+            __m128i out = _mm_or_si128(_mm_or_si128(ri, _mm_slli_epi32(gi, 8)), _mm_or_si128(_mm_slli_epi32(bi, 16), _mm_set1_epi32(0xFF000000u)));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(pixels + i), out);
+        }
+#else
+        for (int i = 0; i < count; i++)
+        {
+            float r = pixels[i] & 0xFF;
+            float g = (pixels[i] >> 8) & 0xFF;
+            float b = (pixels[i] >> 16) & 0xFF;
+            float nr = r * m[0] + g * m[1] + b * m[2];
+            float ng = r * m[3] + g * m[4] + b * m[5];
+            float nb = r * m[6] + g * m[7] + b * m[8];
+            float scale = brightness * (1.0f - mask[i] * vignetteScale);
+            float redScale = brightness * (1.0f - mask[i] * vignetteRedScale);
+            nr = nr * redScale * (1.0f - flash) + flash * 255.0f;
+            ng = ng * scale * (1.0f - flash);
+            nb = nb * scale * (1.0f - flash);
+            int ri = static_cast<int>(std::clamp(nr, 0.0f, 255.0f) + 0.5f);
+            int gi = static_cast<int>(std::clamp(ng, 0.0f, 255.0f) + 0.5f);
+            int bi = static_cast<int>(std::clamp(nb, 0.0f, 255.0f) + 0.5f);
+            pixels[i] = 0xFF000000u | (static_cast<uint32_t>(gammaTable[bi]) << 16) | (static_cast<uint32_t>(gammaTable[gi]) << 8) | gammaTable[ri];
+        }
+#endif
+    }
+}
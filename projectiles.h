@@ -0,0 +1,161 @@
+#pragma once
+#include "globals.h"
+#include "spritebins.h"
+#include <cmath>
+#include <vector>
+#include <initializer_list>
+
+namespace Projectiles
+{
+    // Bullets of both sides live in sprite slots owned by this pool. Slots of dead bullets are handed out
+    // again instead of growing sprites for the whole level, and no more than capacity fly at once
+    const int capacity = 512;
+
+    // slots holding a projectile that was alive at the last collect or spawned since, and slots free for reuse
+    std::vector<int> live;
+    std::vector<int> freeSlots;
+
+    // How many seconds the projectile in a slot can fly along its velocity before it is inside a wall,
+    // traced when it spawns and again only if a tile changed since then
+    struct Flight
+    {
+        float wallTime;
+        int mapRevision;
+    };
+    std::vector<Flight> flights;
+
+    // Grid walk from (x, y) along the unit direction (dirX, dirY), returns the distance at which it enters
+    // the first wall or leaves the map
+    float wallDistance(float x, float y, float dirX, float dirY)
+    {
+        int cellX = floor(x / cellWidth);
+        int cellY = floor(y / cellWidth);
+        int stepX = dirX < 0 ? -1 : 1;
+        int stepY = dirY < 0 ? -1 : 1;
+        float deltaX = dirX == 0 ? 1e30f : std::fabs(cellWidth / dirX);
+        float deltaY = dirY == 0 ? 1e30f : std::fabs(cellWidth / dirY);
+        float nextX = dirX == 0 ? 1e30f : ((dirX < 0 ? cellX * cellWidth : (cellX + 1) * cellWidth) - x) / dirX;
+        float nextY = dirY == 0 ? 1e30f : ((dirY < 0 ? cellY * cellWidth : (cellY + 1) * cellWidth) - y) / dirY;
+        float distance = 0;
+
+        while (cellX >= 0 && cellX < mapX && cellY >= 0 && cellY < mapY && map[cellY * mapX + cellX] == 0)
+        {
+            if (nextX < nextY)
+            {
+                distance = nextX;
+                nextX += deltaX;
+                cellX += stepX;
+            }
+            else
+            {
+                distance = nextY;
+                nextY += deltaY;
+                cellY += stepY;
+            }
+        }
+        return distance;
+    }
+
+    void aim(int slot)
+    {
+        Flight &flight = flights[slot];
+        float speed = std::sqrt(sprites.velocityX[slot] * sprites.velocityX[slot] + sprites.velocityY[slot] * sprites.velocityY[slot]);
+        flight.wallTime = wallDistance(sprites.x[slot], sprites.y[slot], sprites.velocityX[slot] / speed, sprites.velocityY[slot] / speed) / speed;
+        flight.mapRevision = mapRevision;
+    }
+
+    // Seconds the projectile in slot can still fly before it is inside a wall
+    float clearance(int slot)
+    {
+        if (flights[slot].mapRevision != mapRevision)
+        {
+            aim(slot);
+        }
+        return flights[slot].wallTime;
+    }
+
+    // Moves the projectile in slot along its velocity for seconds, which must not be past its clearance
+    void fly(int slot, float seconds)
+    {
+        sprites.x[slot] += sprites.velocityX[slot] * seconds;
+        sprites.y[slot] += sprites.velocityY[slot] * seconds;
+        flights[slot].wallTime -= seconds;
+    }
+
+    // Returns the slot the projectile went into, or -1 when the pool is full and it is dropped
+    int spawn(const Sprite &projectile)
+    {
+        if (live.size() >= capacity)
+            return -1;
+        int slot;
+        if (!freeSlots.empty())
+        {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+            sprites.set(slot, projectile);
+            SpriteBins::revive(slot);
+        }
+        else
+        {
+            slot = sprites.size();
+            sprites.add(projectile);
+        }
+        float direction = projectile.direction.value() * M_PI / 180.0;
+        sprites.velocityX[slot] = cos(direction) * bulletSpeed;
+        sprites.velocityY[slot] = sin(direction) * bulletSpeed;
+        if (flights.size() <= slot)
+        {
+            flights.resize(slot + 1);
+        }
+        aim(slot);
+        live.push_back(slot);
+        return slot;
+    }
+
+    // one projectile per offset, each turned that many degrees from projectile.direction
+    void burst(Sprite projectile, std::initializer_list<float> offsets)
+    {
+        float direction = projectile.direction.value();
+        for (float offset : offsets)
+        {
+            projectile.direction = direction + offset;
+            spawn(projectile);
+        }
+    }
+
+    // count projectiles starting at firstOffset degrees from projectile.direction, step degrees apart
+    void fan(Sprite projectile, float firstOffset, float step, int count)
+    {
+        float direction = projectile.direction.value();
+        for (int k = 0; k < count; k++)
+        {
+            projectile.direction = direction + firstOffset + k * step;
+            spawn(projectile);
+        }
+    }
+
+    // Frees the slots of projectiles that died and packs the live list.
+    // Call after SpriteBins::update, which is what takes dead projectiles out of the bins
+    void collect()
+    {
+        for (int k = 0; k < live.size();)
+        {
+            if (sprites.active[live[k]].value)
+            {
+                k++;
+                continue;
+            }
+            freeSlots.push_back(live[k]);
+            live[k] = live.back();
+            live.pop_back();
+        }
+    }
+
+    // call when the sprites of a new level are about to be loaded
+    void reset()
+    {
+        live.clear();
+        freeSlots.clear();
+        flights.clear();
+    }
+}
@@ -0,0 +1,345 @@
+#pragma once
+#include "globals.h"
+#include <cstdint>
+#include <algorithm>
+#include <vector>
+#include <list>
+#include <map>
+
+namespace Pvs
+{
+    // For every floor cell, the cells visible from somewhere inside it as one bit per map cell. A cell sees a few
+    // rooms at most, so a set only keeps its non-zero 64 bit words along with their word index. Cells in the same
+    // room tend to see the same cells, so identical sets are stored once and cells keep an index
+    struct Set
+    {
+        // into wordIndex and wordBits
+        int first;
+        int count;
+        uint64_t hash;
+        // cells whose set it is, the set is dropped once this reaches zero
+        int users;
+    };
+
+    int words = 0;
+    std::vector<Set> sets;
+    std::vector<uint16_t> wordIndex;
+    std::vector<uint64_t> wordBits;
+    std::vector<int> cellSet;
+    std::multimap<uint64_t, int> setIds;
+
+    // Cells that could see a tile that changed are re-traced a slice per frame, until then they see everything
+    const int cellsPerFrame = 64;
+    const int queued = -2;
+    std::vector<int> retrace;
+    int retraceHead = 0;
+
+    // A sight line through two lattice points given relative to the lower left corner of the source cell, near is
+    // the one closer to the source
+    struct Line
+    {
+        int nearX, nearY, farX, farY;
+
+        // positive when (x, y) is on the steeper side of the line, zero when on it
+        int side(int x, int y) const
+        {
+            return (farX - nearX) * (y - farY) - (farY - nearY) * (x - farX);
+        }
+    };
+
+    // a corner that bent one of the lines, with the bump it was added after
+    struct Bump
+    {
+        int x, y;
+        int parent;
+    };
+
+    // the sight lines still open between a shallow and a steep line
+    struct Field
+    {
+        Line shallow;
+        Line steep;
+        int shallowBump = -1;
+        int steepBump = -1;
+    };
+
+    std::vector<Bump> bumps;
+
+    void setBit(std::vector<uint64_t> &bits, int cell)
+    {
+        bits[cell >> 6] |= uint64_t(1) << (cell & 63);
+    }
+
+    void addShallowBump(int x, int y, Field &field)
+    {
+        field.shallow.farX = x;
+        field.shallow.farY = y;
+        bumps.push_back({x, y, field.shallowBump});
+        field.shallowBump = bumps.size() - 1;
+        for (int b = field.steepBump; b != -1; b = bumps[b].parent)
+        {
+            if (field.shallow.side(bumps[b].x, bumps[b].y) < 0)
+            {
+                field.shallow.nearX = bumps[b].x;
+                field.shallow.nearY = bumps[b].y;
+            }
+        }
+    }
+
+    void addSteepBump(int x, int y, Field &field)
+    {
+        field.steep.farX = x;
+        field.steep.farY = y;
+        bumps.push_back({x, y, field.steepBump});
+        field.steepBump = bumps.size() - 1;
+        for (int b = field.shallowBump; b != -1; b = bumps[b].parent)
+        {
+            if (field.steep.side(bumps[b].x, bumps[b].y) > 0)
+            {
+                field.steep.nearX = bumps[b].x;
+                field.steep.nearY = bumps[b].y;
+            }
+        }
+    }
+
+    // a field whose lines met along a line through the source cell's corner has no sight lines left
+    bool closed(const Field &field)
+    {
+        const Line &shallow = field.shallow;
+        return shallow.side(field.steep.nearX, field.steep.nearY) == 0 && shallow.side(field.steep.farX, field.steep.farY) == 0 &&
+               (shallow.side(0, 1) == 0 || shallow.side(1, 0) == 0);
+    }
+
+    // Permissive field of view over one quadrant: a cell is marked when a line from some point of the source cell
+    // reaches some point of it without passing through the inside of a wall, so the set is exact rather than sampled
+    void traceQuadrant(int sourceX, int sourceY, int signX, int signY, std::vector<uint64_t> &bits)
+    {
+        int extentX = signX > 0 ? mapX - 1 - sourceX : sourceX;
+        int extentY = signY > 0 ? mapY - 1 - sourceY : sourceY;
+        int reach = mapX + mapY;
+
+        std::list<Field> fields(1);
+        fields.front().shallow = {0, 1, reach, 0};
+        fields.front().steep = {1, 0, 0, reach};
+        bumps.clear();
+
+        for (int ring = 1; ring <= extentX + extentY && !fields.empty(); ring++)
+        {
+            auto field = fields.begin();
+            for (int j = std::max(0, ring - extentX); j <= std::min(ring, extentY) && field != fields.end(); j++)
+            {
+                int x = ring - j;
+                int y = j;
+                // cells are visited from shallow to steep, skip the fields wholly below this one
+                while (field != fields.end() && field->steep.side(x + 1, y) >= 0)
+                {
+                    ++field;
+                }
+                if (field == fields.end())
+                    break;
+                if (field->shallow.side(x, y + 1) <= 0)
+                    continue;
+
+                int cell = (sourceY + signY * y) * mapX + sourceX + signX * x;
+                setBit(bits, cell);
+                if (map[cell] == 0)
+                    continue;
+
+                bool cutsShallow = field->shallow.side(x + 1, y) < 0;
+                bool cutsSteep = field->steep.side(x, y + 1) > 0;
+                if (cutsShallow && cutsSteep)
+                {
+                    field = fields.erase(field);
+                }
+                else if (cutsShallow)
+                {
+                    addShallowBump(x, y + 1, *field);
+                    if (closed(*field))
+                        field = fields.erase(field);
+                }
+                else if (cutsSteep)
+                {
+                    addSteepBump(x + 1, y, *field);
+                    if (closed(*field))
+                        field = fields.erase(field);
+                }
+                else
+                {
+                    // the wall splits the field in two
+                    auto shallower = fields.insert(field, *field);
+                    addSteepBump(x + 1, y, *shallower);
+                    if (closed(*shallower))
+                        fields.erase(shallower);
+                    addShallowBump(x, y + 1, *field);
+                    if (closed(*field))
+                        field = fields.erase(field);
+                }
+            }
+        }
+    }
+
+    bool matches(const Set &set, const std::vector<uint64_t> &bits)
+    {
+        int count = std::count_if(bits.begin(), bits.end(), [](uint64_t word)
+                                  { return word != 0; });
+        if (count != set.count)
+            return false;
+        for (int k = set.first; k < set.first + set.count; k++)
+        {
+            if (bits[wordIndex[k]] != wordBits[k])
+                return false;
+        }
+        return true;
+    }
+
+    int intern(const std::vector<uint64_t> &bits)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (uint64_t word : bits)
+        {
+            hash = (hash ^ word) * 1099511628211ull;
+        }
+        auto range = setIds.equal_range(hash);
+        for (auto found = range.first; found != range.second; ++found)
+        {
+            if (matches(sets[found->second], bits))
+            {
+                sets[found->second].users++;
+                return found->second;
+            }
+        }
+        Set set = {static_cast<int>(wordBits.size()), 0, hash, 1};
+        for (int word = 0; word < words; word++)
+        {
+            if (bits[word] == 0)
+                continue;
+            wordIndex.push_back(word);
+            wordBits.push_back(bits[word]);
+            set.count++;
+        }
+        sets.push_back(set);
+        setIds.emplace(hash, sets.size() - 1);
+        return sets.size() - 1;
+    }
+
+    void computeCell(int cell)
+    {
+        if (cellSet[cell] >= 0)
+        {
+            sets[cellSet[cell]].users--;
+        }
+        if (map[cell] != 0)
+        {
+            cellSet[cell] = -1;
+            return;
+        }
+        std::vector<uint64_t> bits(words, 0);
+        setBit(bits, cell);
+        const int signs[4][2] = {{1, 1}, {-1, 1}, {1, -1}, {-1, -1}};
+        for (const auto &sign : signs)
+        {
+            traceQuadrant(cell % mapX, cell / mapX, sign[0], sign[1], bits);
+        }
+        cellSet[cell] = intern(bits);
+    }
+
+    // drops the sets no cell uses any more and renumbers the rest
+    void compact()
+    {
+        std::vector<int> renumbered(sets.size(), -1);
+        std::vector<Set> kept;
+        std::vector<uint16_t> keptIndex;
+        std::vector<uint64_t> keptBits;
+        setIds.clear();
+        for (int id = 0; id < sets.size(); id++)
+        {
+            Set set = sets[id];
+            if (set.users == 0)
+                continue;
+            set.first = keptBits.size();
+            keptIndex.insert(keptIndex.end(), wordIndex.begin() + sets[id].first, wordIndex.begin() + sets[id].first + set.count);
+            keptBits.insert(keptBits.end(), wordBits.begin() + sets[id].first, wordBits.begin() + sets[id].first + set.count);
+            renumbered[id] = kept.size();
+            setIds.emplace(set.hash, kept.size());
+            kept.push_back(set);
+        }
+        for (int &id : cellSet)
+        {
+            if (id >= 0)
+            {
+                id = renumbered[id];
+            }
+        }
+        sets.swap(kept);
+        wordIndex.swap(keptIndex);
+        wordBits.swap(keptBits);
+    }
+
+    // call once the map of a new level is loaded
+    void build()
+    {
+        words = (mapX * mapY + 63) / 64;
+        sets.clear();
+        wordIndex.clear();
+        wordBits.clear();
+        setIds.clear();
+        retrace.clear();
+        retraceHead = 0;
+        cellSet.assign(mapX * mapY, -1);
+        for (int cell = 0; cell < mapX * mapY; cell++)
+        {
+            computeCell(cell);
+        }
+    }
+
+    // Unknown cells and cells waiting to be re-traced count as visible so a missing set never hides anything
+    bool visible(int from, int to)
+    {
+        if (from < 0 || to < 0 || from >= cellSet.size() || to >= cellSet.size() || cellSet[from] < 0)
+        {
+            return true;
+        }
+        const Set &set = sets[cellSet[from]];
+        auto begin = wordIndex.begin() + set.first;
+        auto end = begin + set.count;
+        auto found = std::lower_bound(begin, end, to >> 6);
+        if (found == end || *found != to >> 6)
+            return false;
+        return (wordBits[found - wordIndex.begin()] >> (to & 63)) & 1;
+    }
+
+    // Queues the cells that could see a tile that just changed, new sight lines can only pass through it
+    void patch(int cell)
+    {
+        if (cell < 0 || cell >= cellSet.size())
+            return;
+        for (int from = 0; from < cellSet.size(); from++)
+        {
+            if (cellSet[from] == queued || (from != cell && (cellSet[from] == -1 || !visible(from, cell))))
+                continue;
+            if (cellSet[from] >= 0)
+            {
+                sets[cellSet[from]].users--;
+            }
+            cellSet[from] = queued;
+            retrace.push_back(from);
+        }
+    }
+
+    // Call once per frame while no other thread reads the sets, the sets left unused are dropped once the queue is empty
+    void update()
+    {
+        if (retraceHead == retrace.size())
+            return;
+        for (int budget = cellsPerFrame; budget > 0 && retraceHead < retrace.size(); budget--)
+        {
+            computeCell(retrace[retraceHead++]);
+        }
+        if (retraceHead == retrace.size())
+        {
+            retrace.clear();
+            retraceHead = 0;
+            compact();
+        }
+    }
+}
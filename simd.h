@@ -0,0 +1,137 @@
+#pragma once
+#include "types.h"
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define USE_SSE2 1
+#endif
+
+// texels and framebuffer pixels are both RGBA bytes, so a texel can be copied straight into the frame
+uint32_t texelAt(const Texture &tex, int x, int y)
+{
+  uint32_t texel;
+  std::memcpy(&texel, tex.data + (y * tex.width + x) * 4, sizeof(texel));
+  return texel;
+}
+
+uint32_t sampleNearest(const Texture &tex, int x, int y)
+{
+  x = std::clamp(x, 0, tex.width - 1);
+  y = std::clamp(y, 0, tex.height - 1);
+  return texelAt(tex, x, y);
+}
+
+int wrapCoord(int a, int size)
+{
+  a %= size;
+  return a < 0 ? a + size : a;
+}
+
+// Bilinear filters four lanes at once. u and v are in texels, textures[k] may be null to skip a lane.
+// Weights are 7 bit so (b - a) * w stays inside a signed 16 bit lane, which lets two RGBA pixels share one register.
+void sampleBilinear4(const Texture *const *textures, const float *u, const float *v, bool wrap, uint32_t *out)
+{
+  alignas(16) uint32_t t00[4], t10[4], t01[4], t11[4];
+  alignas(16) int32_t x0[4], y0[4], wx[4], wy[4];
+
+#ifdef USE_SSE2
+  __m128 fx = _mm_sub_ps(_mm_loadu_ps(u), _mm_set1_ps(0.5f));
+  __m128 fy = _mm_sub_ps(_mm_loadu_ps(v), _mm_set1_ps(0.5f));
+  __m128i ix = _mm_cvttps_epi32(fx);
+  __m128i iy = _mm_cvttps_epi32(fy);
+  // truncation rounds negative coordinates up, step those back down to get floor
+  ix = _mm_add_epi32(ix, _mm_castps_si128(_mm_cmplt_ps(fx, _mm_cvtepi32_ps(ix))));
+  iy = _mm_add_epi32(iy, _mm_castps_si128(_mm_cmplt_ps(fy, _mm_cvtepi32_ps(iy))));
+  __m128 scale = _mm_set1_ps(128.0f);
+  _mm_store_si128(reinterpret_cast<__m128i *>(wx), _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(fx, _mm_cvtepi32_ps(ix)), scale)));
+  _mm_store_si128(reinterpret_cast<__m128i *>(wy), _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(fy, _mm_cvtepi32_ps(iy)), scale)));
+  _mm_store_si128(reinterpret_cast<__m128i *>(x0), ix);
+  _mm_store_si128(reinterpret_cast<__m128i *>(y0), iy);
+#else
+  for (int k = 0; k < 4; k++)
+  {
+    float fx = u[k] - 0.5f;
+    float fy = v[k] - 0.5f;
+    x0[k] = static_cast<int>(std::floor(fx));
+    y0[k] = static_cast<int>(std::floor(fy));
+    wx[k] = static_cast<int>((fx - x0[k]) * 128);
+    wy[k] = static_cast<int>((fy - y0[k]) * 128);
+  }
+#endif
+
+  for (int k = 0; k < 4; k++)
+  {
+    const Texture *tex = textures[k];
+    if (!tex)
+    {
+      t00[k] = t10[k] = t01[k] = t11[k] = 0;
+      continue;
+    }
+    int xa, xb, ya, yb;
+    if (wrap)
+    {
+      xa = wrapCoord(x0[k], tex->width);
+      xb = wrapCoord(x0[k] + 1, tex->width);
+      ya = wrapCoord(y0[k], tex->height);
+      yb = wrapCoord(y0[k] + 1, tex->height);
+    }
+    else
+    {
+      xa = std::clamp(x0[k], 0, tex->width - 1);
+      xb = std::clamp(x0[k] + 1, 0, tex->width - 1);
+      ya = std::clamp(y0[k], 0, tex->height - 1);
+      yb = std::clamp(y0[k] + 1, 0, tex->height - 1);
+    }
+    t00[k] = texelAt(*tex, xa, ya);
+    t10[k] = texelAt(*tex, xb, ya);
+    t01[k] = texelAt(*tex, xa, yb);
+    t11[k] = texelAt(*tex, xb, yb);
+  }
+
+#ifdef USE_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  __m128i p00 = _mm_load_si128(reinterpret_cast<const __m128i *>(t00));
+  __m128i p10 = _mm_load_si128(reinterpret_cast<const __m128i *>(t10));
+  __m128i p01 = _mm_load_si128(reinterpret_cast<const __m128i *>(t01));
+  __m128i p11 = _mm_load_si128(reinterpret_cast<const __m128i *>(t11));
+
+  // each half holds two pixels as 8 x 16 bit channels, weights are broadcast over a pixel's four channels
+  __m128i wxLo = _mm_set_epi16(wx[1], wx[1], wx[1], wx[1], wx[0], wx[0], wx[0], wx[0]);
+  __m128i wxHi = _mm_set_epi16(wx[3], wx[3], wx[3], wx[3], wx[2], wx[2], wx[2], wx[2]);
+  __m128i wyLo = _mm_set_epi16(wy[1], wy[1], wy[1], wy[1], wy[0], wy[0], wy[0], wy[0]);
+  __m128i wyHi = _mm_set_epi16(wy[3], wy[3], wy[3], wy[3], wy[2], wy[2], wy[2], wy[2]);
+
+  auto lerp = [](__m128i a, __m128i b, __m128i w)
+  {
+    return _mm_add_epi16(a, _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(b, a), w), 7));
+  };
+
+  __m128i topLo = lerp(_mm_unpacklo_epi8(p00, zero), _mm_unpacklo_epi8(p10, zero), wxLo);
+  __m128i topHi = lerp(_mm_unpackhi_epi8(p00, zero), _mm_unpackhi_epi8(p10, zero), wxHi);
+  __m128i bottomLo = lerp(_mm_unpacklo_epi8(p01, zero), _mm_unpacklo_epi8(p11, zero), wxLo);
+  __m128i bottomHi = lerp(_mm_unpackhi_epi8(p01, zero), _mm_unpackhi_epi8(p11, zero), wxHi);
+
+  __m128i result = _mm_packus_epi16(lerp(topLo, bottomLo, wyLo), lerp(topHi, bottomHi, wyHi));
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(out), result);
+#else
+  for (int k = 0; k < 4; k++)
+  {
+    uint32_t pixel = 0;
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+      int a = (t00[k] >> shift) & 0xFF;
+      int b = (t10[k] >> shift) & 0xFF;
+      int c = (t01[k] >> shift) & 0xFF;
+      int d = (t11[k] >> shift) & 0xFF;
+      int top = a + (((b - a) * wx[k]) >> 7);
+      int bottom = c + (((d - c) * wx[k]) >> 7);
+      pixel |= static_cast<uint32_t>(top + (((bottom - top) * wy[k]) >> 7)) << shift;
+    }
+    out[k] = pixel;
+  }
+#endif
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+namespace SimThread
+{
+    // One thread that runs the world tick handed to it while the main thread draws the frame before it.
+    // Started on first use, it sleeps whenever no tick is pending
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    std::function<void()> tick;
+    bool pending = false;
+    bool stopping = false;
+
+    void loop()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            wake.wait(lock, []
+                      { return stopping || pending; });
+            if (stopping)
+                return;
+            lock.unlock();
+            tick();
+            lock.lock();
+            pending = false;
+            finished.notify_all();
+        }
+    }
+
+    // Runs fn on the simulation thread, the caller must wait for the previous tick first
+    void start(const std::function<void()> &fn)
+    {
+        if (!thread.joinable())
+        {
+            thread = std::thread(loop);
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tick = fn;
+            pending = true;
+        }
+        wake.notify_one();
+    }
+
+    // Returns once no tick is running, everything the tick wrote is visible to the caller afterwards
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, []
+                      { return !pending; });
+    }
+
+    void stop()
+    {
+        wait();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+        stopping = false;
+    }
+}
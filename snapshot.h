@@ -0,0 +1,65 @@
+#pragma once
+#include "globals.h"
+#include <cmath>
+#include <vector>
+
+namespace Snapshot
+{
+    // What the views draw of the sprites, copied from the live store while the simulation thread is parked.
+    // Frames are drawn from the copy while the next tick moves the live sprites, only active sprites are kept
+    struct Entity
+    {
+        SpriteType type;
+        float x;
+        float y;
+        float z;
+        float scaleX;
+        float scaleY;
+        bool trap;
+    };
+
+    std::vector<Entity> entities;
+    // entity indices by the map cell their centre is in, entities off the map land in outside
+    std::vector<std::vector<int>> cells;
+    std::vector<int> outside;
+    std::vector<int> filledCells;
+
+    // call between ticks, after any level load of the frame
+    void capture()
+    {
+        if (cells.size() != mapX * mapY)
+        {
+            cells.assign(mapX * mapY, {});
+            filledCells.clear();
+        }
+        for (int cell : filledCells)
+        {
+            cells[cell].clear();
+        }
+        filledCells.clear();
+        outside.clear();
+        entities.clear();
+
+        for (int i = 0; i < sprites.size(); i++)
+        {
+            if (sprites.active[i].value == false)
+                continue;
+            int index = entities.size();
+            entities.push_back({sprites.type[i], sprites.x[i], sprites.y[i], sprites.z[i], sprites.scaleX[i], sprites.scaleY[i], sprites.trap[i].value});
+
+            int cellX = floor(sprites.x[i] / cellWidth);
+            int cellY = floor(sprites.y[i] / cellWidth);
+            if (cellX < 0 || cellX >= mapX || cellY < 0 || cellY >= mapY)
+            {
+                outside.push_back(index);
+                continue;
+            }
+            int cell = cellY * mapX + cellX;
+            if (cells[cell].empty())
+            {
+                filledCells.push_back(cell);
+            }
+            cells[cell].push_back(index);
+        }
+    }
+}
@@ -0,0 +1,143 @@
+#pragma once
+#include "globals.h"
+#include <vector>
+#include <algorithm>
+
+namespace SpriteBins
+{
+    // sprite indices grouped by the map cell their centre is in, sprites off the map land in outside
+    std::vector<std::vector<int>> cells;
+    std::vector<int> outside;
+    // bin each sprite currently sits in, and the sprites that can still move between bins
+    std::vector<int> spriteCell;
+    std::vector<int> dynamicSprites;
+
+    int cellOf(int i)
+    {
+        int cellX = floor(sprites.x[i] / cellWidth);
+        int cellY = floor(sprites.y[i] / cellWidth);
+        if (cellX < 0 || cellX >= mapX || cellY < 0 || cellY >= mapY)
+        {
+            return -1;
+        }
+        return cellY * mapX + cellX;
+    }
+
+    std::vector<int> &bin(int cell)
+    {
+        return cell == -1 ? outside : cells[cell];
+    }
+
+    void remove(int i)
+    {
+        std::vector<int> &indices = bin(spriteCell[i]);
+        auto it = std::find(indices.begin(), indices.end(), i);
+        if (it != indices.end())
+        {
+            *it = indices.back();
+            indices.pop_back();
+        }
+    }
+
+    // Re-bins sprite i right after it moved, so queries later in the same frame find it in its new cell.
+    // Sprites added this frame are left to update
+    void moved(int i)
+    {
+        if (i >= spriteCell.size())
+            return;
+        int cell = cellOf(i);
+        if (cell != spriteCell[i])
+        {
+            remove(i);
+            spriteCell[i] = cell;
+            bin(cell).push_back(i);
+        }
+    }
+
+    // Puts a recycled slot back into the bins, update took it out when the sprite that had it died
+    void revive(int i)
+    {
+        if (i >= spriteCell.size())
+            return;
+        spriteCell[i] = cellOf(i);
+        bin(spriteCell[i]).push_back(i);
+        if (sprites.components[i] & Moves)
+        {
+            dynamicSprites.push_back(i);
+        }
+    }
+
+    // Calls fn(i) for every binned sprite in a cell the square of half size radius around (x, y) touches,
+    // callers still test the exact distance
+    template <typename Fn>
+    void forEachNear(float x, float y, float radius, Fn fn)
+    {
+        int minX = floor((x - radius) / cellWidth);
+        int maxX = floor((x + radius) / cellWidth);
+        int minY = floor((y - radius) / cellWidth);
+        int maxY = floor((y + radius) / cellWidth);
+        bool offMap = false;
+        for (int cellY = minY; cellY <= maxY; cellY++)
+        {
+            for (int cellX = minX; cellX <= maxX; cellX++)
+            {
+                if (cellX < 0 || cellX >= mapX || cellY < 0 || cellY >= mapY)
+                {
+                    offMap = true;
+                    continue;
+                }
+                for (int i : cells[cellY * mapX + cellX])
+                {
+                    fn(i);
+                }
+            }
+        }
+        if (offMap)
+        {
+            for (int i : outside)
+            {
+                fn(i);
+            }
+        }
+    }
+
+    // Bins sprites added since the last call and moves dynamic sprites that crossed into another cell.
+    // Dead dynamic sprites leave their bin for good, static ones stay so spikes can come back up
+    void update()
+    {
+        for (int i = spriteCell.size(); i < sprites.size(); i++)
+        {
+            int cell = cellOf(i);
+            spriteCell.push_back(cell);
+            bin(cell).push_back(i);
+            if (sprites.components[i] & Moves)
+            {
+                dynamicSprites.push_back(i);
+            }
+        }
+
+        for (int d = 0; d < dynamicSprites.size();)
+        {
+            int i = dynamicSprites[d];
+            if (sprites.active[i].value == false)
+            {
+                remove(i);
+                dynamicSprites[d] = dynamicSprites.back();
+                dynamicSprites.pop_back();
+                continue;
+            }
+            moved(i);
+            d++;
+        }
+    }
+
+    // call once the map size is known for a new level, before its sprites are loaded
+    void reset()
+    {
+        cells.assign(mapX * mapY, {});
+        outside.clear();
+        spriteCell.clear();
+        dynamicSprites.clear();
+        update();
+    }
+}
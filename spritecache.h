@@ -0,0 +1,132 @@
+#pragma once
+#include "types.h"
+#include "spritespans.h"
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+
+namespace SpriteCache
+{
+    // Sprites drawn smaller than their texture are read from a copy shrunk to the next power of two above their
+    // projected height, so far away coins and spikes touch a handful of texels and stop shimmering
+    const int minBucketHeight = 4;
+    const int bucketCount = 6;
+    const size_t memoryBudget = 512 * 1024;
+
+    struct Image
+    {
+        Texture texture;
+        std::vector<unsigned char> pixels;
+        SpriteSpans::Columns nearestColumns;
+        SpriteSpans::Columns filteredColumns;
+        uint64_t lastUsed = 0;
+    };
+
+    // one slot per texture and bucket, built lazily on first use and dropped least recently used first.
+    // views look images up from several threads while gathering sprites, images used in the current frame are never
+    // evicted so their pointers stay valid until the frame is drawn
+    std::vector<std::unique_ptr<Image>> slots;
+    size_t usedBytes = 0;
+    uint64_t frame = 1;
+    std::mutex mutex;
+
+    int bucketHeight(int bucket) { return minBucketHeight << bucket; }
+
+    // alpha is kept binary: a shrunk texel is opaque when at least half of the texels it covers are,
+    // and takes the average colour of those opaque texels
+    void shrink(const Texture &source, Image &image, int width, int height)
+    {
+        image.pixels.assign(width * height * 4, 0);
+        for (int y = 0; y < height; y++)
+        {
+            int y0 = y * source.height / height;
+            int y1 = std::max(y0 + 1, (y + 1) * source.height / height);
+            for (int x = 0; x < width; x++)
+            {
+                int x0 = x * source.width / width;
+                int x1 = std::max(x0 + 1, (x + 1) * source.width / width);
+                int sum[3] = {0, 0, 0};
+                int opaque = 0;
+                for (int sy = y0; sy < y1; sy++)
+                {
+                    for (int sx = x0; sx < x1; sx++)
+                    {
+                        const unsigned char *texel = source.data + (sy * source.width + sx) * 4;
+                        if (texel[3] == 0)
+                            continue;
+                        opaque++;
+                        for (int c = 0; c < 3; c++)
+                        {
+                            sum[c] += texel[c];
+                        }
+                    }
+                }
+                if (opaque * 2 < (x1 - x0) * (y1 - y0))
+                    continue;
+                unsigned char *pixel = image.pixels.data() + (y * width + x) * 4;
+                for (int c = 0; c < 3; c++)
+                {
+                    pixel[c] = sum[c] / opaque;
+                }
+                pixel[3] = 255;
+            }
+        }
+        image.texture = {width, height, 4, image.pixels.data()};
+        image.nearestColumns = SpriteSpans::build(image.texture, 0);
+        image.filteredColumns = SpriteSpans::build(image.texture, 1);
+    }
+
+    void evict()
+    {
+        while (usedBytes > memoryBudget)
+        {
+            int oldest = -1;
+            for (int i = 0; i < slots.size(); i++)
+            {
+                if (slots[i] && slots[i]->lastUsed < frame && (oldest == -1 || slots[i]->lastUsed < slots[oldest]->lastUsed))
+                {
+                    oldest = i;
+                }
+            }
+            if (oldest == -1)
+                return;
+            usedBytes -= slots[oldest]->pixels.size();
+            slots[oldest].reset();
+        }
+    }
+
+    // Returns the shrunk copy of texture textureIndex to draw at projectedHeight pixels, or null to use the texture itself
+    const Image *lookup(const std::vector<Texture> &textures, int textureIndex, float projectedHeight)
+    {
+        const Texture &source = textures[textureIndex];
+        int bucket = 0;
+        while (bucket < bucketCount - 1 && bucketHeight(bucket) < projectedHeight)
+        {
+            bucket++;
+        }
+        int height = bucketHeight(bucket);
+        if (height < projectedHeight || height >= source.height)
+        {
+            return nullptr;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (slots.size() != textures.size() * bucketCount)
+        {
+            slots.resize(textures.size() * bucketCount);
+        }
+        std::unique_ptr<Image> &slot = slots[textureIndex * bucketCount + bucket];
+        if (!slot)
+        {
+            slot = std::make_unique<Image>();
+            shrink(source, *slot, std::max(1, source.width * height / source.height), height);
+            usedBytes += slot->pixels.size();
+            slot->lastUsed = frame;
+            evict();
+        }
+        slot->lastUsed = frame;
+        return slot.get();
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include "types.h"
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+namespace SpriteSpans
+{
+    // texel rows [start, end) of one texture column that hold something to draw
+    struct Span
+    {
+        uint16_t start;
+        uint16_t end;
+    };
+
+    // spans of column x are spans[offsets[x]] .. spans[offsets[x + 1] - 1]
+    struct Columns
+    {
+        std::vector<int> offsets;
+        std::vector<Span> spans;
+    };
+
+    // opaque texels for nearest sampling, and opaque texels grown by one for bilinear which also reads the neighbours
+    std::vector<Columns> nearestColumns;
+    std::vector<Columns> filteredColumns;
+
+    Columns build(const Texture &tex, int grow)
+    {
+        std::vector<uint8_t> opaque(tex.width * tex.height, 0);
+        for (int y = 0; y < tex.height; y++)
+        {
+            for (int x = 0; x < tex.width; x++)
+            {
+                if (tex.data[(y * tex.width + x) * 4 + 3] == 0)
+                    continue;
+                for (int gy = std::max(0, y - grow); gy <= std::min(tex.height - 1, y + grow); gy++)
+                {
+                    for (int gx = std::max(0, x - grow); gx <= std::min(tex.width - 1, x + grow); gx++)
+                    {
+                        opaque[gy * tex.width + gx] = 1;
+                    }
+                }
+            }
+        }
+
+        Columns columns;
+        for (int x = 0; x < tex.width; x++)
+        {
+            columns.offsets.push_back(columns.spans.size());
+            for (int y = 0; y < tex.height; y++)
+            {
+                if (!opaque[y * tex.width + x])
+                    continue;
+                int start = y;
+                while (y < tex.height && opaque[y * tex.width + x])
+                {
+                    y++;
+                }
+                columns.spans.push_back({static_cast<uint16_t>(start), static_cast<uint16_t>(y)});
+            }
+        }
+        columns.offsets.push_back(columns.spans.size());
+        return columns;
+    }
+
+    void init(const std::vector<Texture> &textures)
+    {
+        nearestColumns.clear();
+        filteredColumns.clear();
+        for (const auto &tex : textures)
+        {
+            nearestColumns.push_back(build(tex, 0));
+            filteredColumns.push_back(build(tex, 1));
+        }
+    }
+}
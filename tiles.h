@@ -0,0 +1,72 @@
+#pragma once
+#include "globals.h"
+#include <vector>
+
+namespace Tiles
+{
+    // The cells of map listed by the tile in them, and where each cell sits in its list, so finding the cells
+    // of a tile and moving a cell to another tile are constant time
+    std::vector<std::vector<int>> cellsByTile;
+    std::vector<int> slots;
+    const std::vector<int> noCells;
+
+    void add(int cell)
+    {
+        int tile = map[cell];
+        if (tile < 0)
+            return;
+        if (tile >= cellsByTile.size())
+        {
+            cellsByTile.resize(tile + 1);
+        }
+        slots[cell] = cellsByTile[tile].size();
+        cellsByTile[tile].push_back(cell);
+    }
+
+    void remove(int cell)
+    {
+        if (slots[cell] == -1)
+            return;
+        std::vector<int> &cells = cellsByTile[map[cell]];
+        int moved = cells.back();
+        cells[slots[cell]] = moved;
+        slots[moved] = slots[cell];
+        cells.pop_back();
+        slots[cell] = -1;
+    }
+
+    // call once the map of a new level is loaded
+    void build()
+    {
+        cellsByTile.clear();
+        slots.assign(map.size(), -1);
+        for (int cell = 0; cell < map.size(); cell++)
+        {
+            add(cell);
+        }
+    }
+
+    const std::vector<int> &cellsWith(int tile)
+    {
+        if (tile < 0 || tile >= cellsByTile.size())
+        {
+            return noCells;
+        }
+        return cellsByTile[tile];
+    }
+
+    // Lowest cell holding tile or -1, the order a scan of the map would have found them in.
+    // Only walks the cells of that tile
+    int firstCellWith(int tile)
+    {
+        int first = -1;
+        for (int cell : cellsWith(tile))
+        {
+            if (first == -1 || cell < first)
+            {
+                first = cell;
+            }
+        }
+        return first;
+    }
+}
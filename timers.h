@@ -0,0 +1,120 @@
+#pragma once
+#include "globals.h"
+#include <cstdint>
+#include <vector>
+#include <chrono>
+#include <functional>
+
+namespace Timers
+{
+    // Hierarchical timing wheel on the frame clock, in milliseconds. The first wheel has one slot per millisecond
+    // for the next 256 ms, the second one slot per 256 ms for the next minute, anything later waits in overflow.
+    // A timer costs nothing until its slot comes up or is cascaded into the first wheel
+    const int slotBits = 8;
+    const int slotCount = 1 << slotBits;
+
+    struct Timer
+    {
+        uint64_t due;
+        std::function<void()> fire;
+    };
+
+    std::vector<Timer> wheels[2][slotCount];
+    std::vector<Timer> overflow;
+    // every millisecond up to now has fired
+    uint64_t now = 0;
+    int pending = 0;
+    // frame clock at the last reset, which is when the level was loaded
+    uint64_t loadedAt = 0;
+
+    uint64_t frameMs()
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(currentTime.time_since_epoch()).count();
+    }
+
+    void place(Timer &&timer)
+    {
+        uint64_t delta = timer.due - now;
+        if (delta < slotCount)
+        {
+            wheels[0][timer.due & (slotCount - 1)].push_back(std::move(timer));
+        }
+        else if (delta < slotCount * slotCount)
+        {
+            wheels[1][(timer.due >> slotBits) & (slotCount - 1)].push_back(std::move(timer));
+        }
+        else
+        {
+            overflow.push_back(std::move(timer));
+        }
+    }
+
+    void cascade(std::vector<Timer> &slot)
+    {
+        std::vector<Timer> timers;
+        timers.swap(slot);
+        for (auto &timer : timers)
+        {
+            place(std::move(timer));
+        }
+    }
+
+    // Calls fire once the frame clock is delayMs past the current frame, from the advance of that frame
+    void schedule(int delayMs, std::function<void()> fire)
+    {
+        if (now == 0)
+        {
+            now = frameMs();
+        }
+        uint64_t due = std::max(frameMs() + std::max(delayMs, 0), now + 1);
+        place({due, std::move(fire)});
+        pending++;
+    }
+
+    // Fires every timer that came due up to the current frame, in the order they are due
+    void advance()
+    {
+        uint64_t target = frameMs();
+        if (pending == 0)
+        {
+            now = std::max(now, target);
+            return;
+        }
+        while (now < target && pending > 0)
+        {
+            now++;
+            if ((now & (slotCount - 1)) == 0)
+            {
+                if (((now >> slotBits) & (slotCount - 1)) == 0)
+                {
+                    cascade(overflow);
+                }
+                cascade(wheels[1][(now >> slotBits) & (slotCount - 1)]);
+            }
+            std::vector<Timer> due;
+            due.swap(wheels[0][now & (slotCount - 1)]);
+            for (auto &timer : due)
+            {
+                pending--;
+                timer.fire();
+            }
+        }
+        now = std::max(now, target);
+    }
+
+    // drops every timer, call when a new level is loaded
+    void reset()
+    {
+        for (auto &wheel : wheels)
+        {
+            for (auto &slot : wheel)
+            {
+                slot.clear();
+            }
+        }
+        overflow.clear();
+        pending = 0;
+        now = frameMs();
+        loadedAt = now;
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include "globals.h"
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace Triggers
+{
+    // What standing in a floor cell sets off, indexed when a level is loaded so each frame only looks up
+    // the cells the players are in
+    enum Kind : uint8_t
+    {
+        None,
+        Stairs,
+        Spikes
+    };
+
+    std::vector<uint8_t> kinds;
+    // spike sprites by the cell they hurt in
+    std::vector<std::vector<EntityHandle>> spikes;
+    const std::vector<EntityHandle> noSpikes;
+
+    int cellAt(float x, float y)
+    {
+        int cellX = floor(x / cellWidth);
+        int cellY = floor(y / cellWidth);
+        if (cellX < 0 || cellX >= mapX || cellY < 0 || cellY >= mapY)
+        {
+            return -1;
+        }
+        return cellY * mapX + cellX;
+    }
+
+    // call once the floors of a new level are loaded, before its spikes are added
+    void build()
+    {
+        kinds.assign(mapX * mapY, None);
+        spikes.assign(mapX * mapY, {});
+        for (int cell = 0; cell < mapFloors.size() && cell < kinds.size(); cell++)
+        {
+            if (mapFloors[cell] == 19)
+            {
+                kinds[cell] = Stairs;
+            }
+        }
+    }
+
+    void addSpike(EntityHandle spike, float x, float y)
+    {
+        int cell = cellAt(x, y);
+        if (cell == -1 || cell >= spikes.size())
+            return;
+        spikes[cell].push_back(spike);
+        if (kinds[cell] == None)
+        {
+            kinds[cell] = Spikes;
+        }
+    }
+
+    Kind at(int cell)
+    {
+        if (cell < 0 || cell >= kinds.size())
+        {
+            return None;
+        }
+        return static_cast<Kind>(kinds[cell]);
+    }
+
+    const std::vector<EntityHandle> &spikesAt(int cell)
+    {
+        return at(cell) == None ? noSpikes : spikes[cell];
+    }
+}
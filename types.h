@@ -9,6 +9,9 @@
 #include <SDL2/SDL_image.h>
 #include <SDL2/SDL_mixer.h>
 #include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
 
 struct PlayerData
 {
@@ -41,6 +44,154 @@ struct Player
   float FOV;
 };
 
+// Sparse min/max table over a view's per-ray wall distances. Level k holds the min and max of 2^k neighbouring rays,
+// so any range of rays is covered by two overlapping entries
+struct DepthTree
+{
+  std::vector<std::vector<float>> minLevels;
+  std::vector<std::vector<float>> maxLevels;
+
+  void build(const std::vector<float> &depths)
+  {
+    int count = depths.size();
+    int levels = 1;
+    while ((2 << (levels - 1)) <= count)
+    {
+      levels++;
+    }
+    minLevels.resize(levels);
+    maxLevels.resize(levels);
+    minLevels[0] = depths;
+    maxLevels[0] = depths;
+    for (int k = 1; k < levels; k++)
+    {
+      int half = 1 << (k - 1);
+      int width = count - (1 << k) + 1;
+      minLevels[k].resize(width);
+      maxLevels[k].resize(width);
+      for (int i = 0; i < width; i++)
+      {
+        minLevels[k][i] = std::min(minLevels[k - 1][i], minLevels[k - 1][i + half]);
+        maxLevels[k][i] = std::max(maxLevels[k - 1][i], maxLevels[k - 1][i + half]);
+      }
+    }
+  }
+
+  int level(int first, int last) const
+  {
+    int k = 0;
+    while ((2 << k) <= last - first + 1)
+    {
+      k++;
+    }
+    return k;
+  }
+
+  float minDepth(int first, int last) const
+  {
+    int k = level(first, last);
+    return std::min(minLevels[k][first], minLevels[k][last - (1 << k) + 1]);
+  }
+
+  float maxDepth(int first, int last) const
+  {
+    int k = level(first, last);
+    return std::max(maxLevels[k][first], maxLevels[k][last - (1 << k) + 1]);
+  }
+};
+
+// Names one entity across frames and threads. A handle to a slot that was recycled or cleared since no longer resolves
+struct EntityHandle
+{
+  int index = -1;
+  uint32_t generation = 0;
+};
+
+namespace SpriteCache
+{
+  struct Image;
+}
+
+// where a sprite lands on one view, built by the visible-set pass and consumed by the blitter
+struct SpriteProjection
+{
+  int index;
+  int textureIndex;
+  // shrunk copy to draw from or null for the texture itself, looked up once per view so strips never lock the cache
+  const SpriteCache::Image *scaled;
+  float distance;
+  float left, right, top, bottom;
+  int columnStart, columnEnd;
+  int firstRay, lastRay;
+};
+
+// What one sprite did in the parallel phases of a tick. A phase only writes the step of the sprite it runs for,
+// effects on anything else are applied from the steps in sprite order once the phases are done
+struct SpriteStep
+{
+  float fromX = 0;
+  float fromY = 0;
+  int hit = -1;
+  int playerDamage = 0;
+  bool expired = false;
+  bool hitWall = false;
+  bool footsteps = false;
+  // hurt the player in melee and waits out its cooldown from now
+  bool meleeHit = false;
+};
+
+// Columns [columnStart, columnEnd) of a view and the sprites overlapping them, farthest first.
+// A strip owns its pixels so strips can be drawn on separate threads without locking
+struct SpriteStrip
+{
+  int columnStart;
+  int columnEnd;
+  std::vector<int> sprites;
+};
+
+struct InputBindings
+{
+  SDL_Scancode forward;
+  SDL_Scancode back;
+  SDL_Scancode turnLeft;
+  SDL_Scancode turnRight;
+  SDL_Scancode strafeLeft;
+  SDL_Scancode strafeRight;
+  SDL_Scancode strafeLeftAlt;
+  SDL_Scancode strafeRightAlt;
+  SDL_Scancode shoot;
+  SDL_Scancode use;
+  SDL_Scancode slowTurn;
+};
+
+// A player sitting at this machine: their camera, controls, the columns of the screen they see and
+// the scratch buffers their view is rendered with, so views can be drawn side by side on separate threads
+struct LocalPlayer
+{
+  Player player;
+  InputBindings bindings;
+  int viewX;
+  int viewWidth;
+  std::chrono::steady_clock::time_point lastBulletTime;
+  bool shootPressed = false;
+
+  std::vector<float> distances;
+  DepthTree depthTree;
+  std::vector<std::pair<int, float>> rayCells;
+  // cells this view's rays crossed before hitting a wall, and the cells whose sprite bins were already gathered
+  std::vector<uint8_t> visitedMarks;
+  std::vector<int> visitedCells;
+  std::vector<uint8_t> gatheredMarks;
+  std::vector<int> gatheredCells;
+  std::vector<SpriteProjection> visibleSprites;
+  std::vector<uint64_t> sortKeys;
+  std::vector<uint64_t> sortScratch;
+  std::vector<SpriteStrip> strips;
+  // what the view saw this frame, applied to shared state once every view has finished
+  std::vector<int> seenCells;
+  std::vector<int> seenDecalTiles;
+};
+
 enum SpriteType
 {
   Key,
@@ -57,6 +208,7 @@ enum SpriteType
   Swat
 };
 
+// An entity as it is loaded or spawned, the store keeps only plain values and notes which optional ones were given
 struct Sprite
 {
   SpriteType type;
@@ -64,12 +216,176 @@ struct Sprite
   float scaleX = 1;
   float scaleY = 1;
   bool active;
+  bool trap = false;
+  // degrees, projectiles fly this way
   std::optional<float> direction;
   std::optional<float> health;
-  std::optional<std::chrono::_V2::system_clock::time_point> enemyLastBulletTime;
-  std::optional<std::chrono::_V2::system_clock::time_point> enemyLastMeleeTime;
-  std::optional<bool> move;
-  std::optional<int> soundChannel;
+  // can hurt the player, cleared by a hit and set again from the timer wheel once the cooldown is over
+  bool meleeReady = true;
+  bool move = false;
+};
+
+// What an entity takes part in, fixed by its type, and which of its optional fields hold a value
+enum Component : uint8_t
+{
+  // can leave the cell it was binned in
+  Moves = 1,
+  // has per frame behaviour in handleSprites
+  Thinks = 2,
+  // can be hit by the player's bullets
+  Hittable = 4,
+  HasHealth = 8,
+  HasSoundChannel = 16
+};
+
+inline uint8_t componentsOf(SpriteType type)
+{
+  if (type == Enemy || type == ShooterEnemy || type == HammerEnemy || type == DroneEnemy || type == Swat)
+    return Moves | Thinks | Hittable;
+  if (type == Bullet || type == EnemyBullet)
+    return Moves | Thinks;
+  return 0;
+}
+
+// std::vector<bool> packs bits and cannot hand out references, flags are kept one per byte instead
+struct Flag
+{
+  bool value;
+};
+
+// One entity seen through the columns of the store, reads and writes go straight to the packed arrays.
+// Only valid until the next entity is added, loops over many entities read the columns instead
+struct SpriteRef
+{
+  SpriteType &type;
+  float &x;
+  float &y;
+  float &z;
+  float &scaleX;
+  float &scaleY;
+  bool &active;
+  bool &trap;
+  float &health;
+  bool &meleeReady;
+  bool &move;
+  int &soundChannel;
+};
+
+// Entities stored as one packed array per field, so a loop over positions or types does not drag the
+// cold fields of every entity through the cache. Entities are added as a Sprite and split up, optional
+// fields become plain values with a bit in components saying whether they are set
+struct EntityStore
+{
+  std::vector<SpriteType> type;
+  std::vector<uint8_t> components;
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+  // units per second, zero for entities that are not moving
+  std::vector<float> velocityX;
+  std::vector<float> velocityY;
+  std::vector<float> scaleX;
+  std::vector<float> scaleY;
+  std::vector<Flag> active;
+  std::vector<Flag> trap;
+  std::vector<Flag> move;
+  std::vector<Flag> meleeReady;
+  std::vector<float> health;
+  std::vector<int> soundChannel;
+  // every add or set stamps the slot with a new generation, kept counting across clears
+  std::vector<uint32_t> generation;
+  uint32_t nextGeneration = 1;
+
+  size_t size() const
+  {
+    return type.size();
+  }
+
+  void clear()
+  {
+    type.clear();
+    components.clear();
+    x.clear();
+    y.clear();
+    z.clear();
+    velocityX.clear();
+    velocityY.clear();
+    scaleX.clear();
+    scaleY.clear();
+    active.clear();
+    trap.clear();
+    move.clear();
+    meleeReady.clear();
+    health.clear();
+    soundChannel.clear();
+    generation.clear();
+  }
+
+  void add(const Sprite &sprite)
+  {
+    type.push_back(sprite.type);
+    components.push_back(0);
+    x.push_back(0);
+    y.push_back(0);
+    z.push_back(0);
+    velocityX.push_back(0);
+    velocityY.push_back(0);
+    scaleX.push_back(0);
+    scaleY.push_back(0);
+    active.push_back({false});
+    trap.push_back({false});
+    move.push_back({false});
+    meleeReady.push_back({false});
+    health.push_back(0);
+    soundChannel.push_back(-1);
+    generation.push_back(0);
+    set(size() - 1, sprite);
+  }
+
+  // overwrites entity i, for slots that are recycled
+  void set(int i, const Sprite &sprite)
+  {
+    type[i] = sprite.type;
+    components[i] = componentsOf(sprite.type) | (sprite.health.has_value() ? HasHealth : 0);
+    x[i] = sprite.x;
+    y[i] = sprite.y;
+    z[i] = sprite.z;
+    velocityX[i] = 0;
+    velocityY[i] = 0;
+    scaleX[i] = sprite.scaleX;
+    scaleY[i] = sprite.scaleY;
+    active[i] = {sprite.active};
+    trap[i] = {sprite.trap};
+    move[i] = {sprite.move};
+    meleeReady[i] = {sprite.meleeReady};
+    health[i] = sprite.health.value_or(0);
+    soundChannel[i] = -1;
+    generation[i] = nextGeneration++;
+  }
+
+  bool has(int i, Component component) const
+  {
+    return components[i] & component;
+  }
+
+  EntityHandle handle(int i) const
+  {
+    return {i, generation[i]};
+  }
+
+  // slot of the entity the handle names, -1 once it is gone
+  int resolve(EntityHandle handle) const
+  {
+    if (handle.index < 0 || handle.index >= size() || generation[handle.index] != handle.generation)
+      return -1;
+    return handle.index;
+  }
+
+  SpriteRef operator[](int i)
+  {
+    return {type[i], x[i], y[i], z[i], scaleX[i], scaleY[i], active[i].value, trap[i].value,
+            health[i], meleeReady[i].value, move[i].value, soundChannel[i]};
+  }
 };
 
 class Button
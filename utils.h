@@ -2,6 +2,22 @@
 #include "globals.h"
 #include "types.h"
 #include "stb_image.h"
+#include "simd.h"
+#include "spritespans.h"
+#include "spritecache.h"
+#include "spritebins.h"
+#include "projectiles.h"
+#include "timers.h"
+#include "flowfield.h"
+#include "pvs.h"
+#include "triggers.h"
+#include "tiles.h"
+#include "postprocess.h"
+#include "decals.h"
+#include "minimap.h"
+#include "jobs.h"
+#include "simthread.h"
+#include "snapshot.h"
 #include <iostream>
 #include <fstream>
 #include <string>
@@ -19,6 +35,7 @@ void loadTextures()
     }
     loadedTextures.push_back(tex);
   }
+  SpriteSpans::init(loadedTextures);
 }
 
 int getCell(int x, int y)
@@ -34,6 +51,149 @@ int getCell(int x, int y)
   }
 }
 
+// Spikes go up and down every spikeTrapInterval from the timer wheel rather than checking the clock each frame
+void scheduleSpikeToggle(EntityHandle spike)
+{
+  auto toggle = [spike]()
+  {
+    int i = sprites.resolve(spike);
+    if (i == -1)
+      return;
+    sprites[i].active = !sprites[i].active;
+    scheduleSpikeToggle(spike);
+  };
+  Timers::schedule(spikeTrapInterval, toggle);
+}
+
+// how long an entity waits between hits on a player, 0 for entities that never hit twice
+int meleeCooldown(SpriteType type)
+{
+  if (type == Enemy || type == ShooterEnemy || type == Swat)
+    return enemyMeleeCooldown;
+  if (type == HammerEnemy)
+    return hammerEnemyMeleeCooldown;
+  if (type == Spike)
+    return spikeCooldown;
+  return 0;
+}
+
+// Lets an entity that just hit a player hit again once its cooldown is over
+void rearmMelee(EntityHandle entity)
+{
+  int i = sprites.resolve(entity);
+  if (i == -1)
+    return;
+  sprites[i].meleeReady = false;
+  auto rearm = [entity]()
+  {
+    int i = sprites.resolve(entity);
+    if (i != -1)
+    {
+      sprites[i].meleeReady = true;
+    }
+  };
+  Timers::schedule(meleeCooldown(sprites[i].type) + 1, rearm);
+}
+
+// The boss's attacks come from the timer wheel, the callbacks only raise flags in BossValues and handleSwatBoss acts
+// on them. Every timer stops once the boss is gone
+bool bossAlive(EntityHandle boss)
+{
+  int i = sprites.resolve(boss);
+  return i != -1 && sprites[i].active == true;
+}
+
+void scheduleBossVolley(EntityHandle boss, int delayMs)
+{
+  int round = ++BossValues::volleyRound;
+  auto due = [boss, round]()
+  {
+    if (round != BossValues::volleyRound || !bossAlive(boss))
+      return;
+    BossValues::volleyDue = true;
+    scheduleBossVolley(boss, BossValues::shootingCooldown + 1);
+  };
+  Timers::schedule(delayMs, due);
+}
+
+void scheduleBossBigAttack(EntityHandle boss)
+{
+  auto due = [boss]()
+  {
+    if (!bossAlive(boss))
+      return;
+    BossValues::bigAttackDue = true;
+    scheduleBossBigAttack(boss);
+  };
+  Timers::schedule(BossValues::bigAttackTime + 1, due);
+}
+
+void scheduleBossStrafe(EntityHandle boss)
+{
+  auto turn = [boss]()
+  {
+    if (!bossAlive(boss))
+      return;
+    BossValues::strafeDir = BossValues::strafeDir == 0 ? 1 : 0;
+    scheduleBossStrafe(boss);
+  };
+  Timers::schedule(BossValues::generateStrafingTime() + 1, turn);
+}
+
+// A charge lasts chargeDuration and the next one is scheduled as it starts
+void scheduleBossCharge(EntityHandle boss, int delayMs)
+{
+  int round = ++BossValues::chargeRound;
+  auto charge = [boss, round]()
+  {
+    if (round != BossValues::chargeRound || !bossAlive(boss))
+      return;
+    BossValues::charging = true;
+    BossValues::chargeHurried = false;
+    BossValues::chargeStartedMs = Timers::now;
+    int count = ++BossValues::chargeCount;
+    auto end = [count]()
+    {
+      if (count == BossValues::chargeCount)
+      {
+        BossValues::charging = false;
+      }
+    };
+    Timers::schedule(BossValues::chargeDuration, end);
+    scheduleBossCharge(boss, BossValues::generateChargeTime() + 1);
+  };
+  Timers::schedule(delayMs, charge);
+}
+
+// Brings the next charge forward to hurriedChargeTime after the last one started, once per charge
+void hurryBossCharge(EntityHandle boss)
+{
+  if (BossValues::chargeHurried)
+    return;
+  BossValues::chargeHurried = true;
+  int sinceCharge = Timers::frameMs() - BossValues::chargeStartedMs;
+  scheduleBossCharge(boss, BossValues::hurriedChargeTime + 1 - sinceCharge);
+}
+
+// call when the boss is loaded, its clocks start with the level
+void startBoss(EntityHandle boss)
+{
+  BossValues::strafeDir = 0;
+  BossValues::volleyDue = false;
+  BossValues::bigAttackDue = false;
+  BossValues::charging = false;
+  BossValues::chargeHurried = false;
+  BossValues::chargeStartedMs = Timers::frameMs();
+  BossValues::door1 = false;
+  BossValues::door2 = false;
+  BossValues::door3 = false;
+  BossValues::door4 = false;
+  scheduleBossVolley(boss, BossValues::shootingCooldown + 1);
+  scheduleBossBigAttack(boss);
+  scheduleBossStrafe(boss);
+  scheduleBossCharge(boss, BossValues::generateChargeTime() + 1);
+}
+
 void deserialize(const std::string &filename)
 {
   std::ifstream file(filename, std::ios::binary | std::ios::in);
@@ -58,6 +218,15 @@ void deserialize(const std::string &filename)
     mapCeiling.resize(count);
     file.read(reinterpret_cast<char *>(mapCeiling.data()), sizeof(int) * count);
     file.close();
+    Decals::reset();
+    Minimap::reset();
+    SpriteBins::reset();
+    Projectiles::reset();
+    Timers::reset();
+    FlowField::reset();
+    Pvs::build();
+    Triggers::build();
+    Tiles::build();
   }
   else
   {
@@ -70,26 +239,83 @@ void deserialize(const std::string &filename)
     {
       if (mapFloors[getCell(x, y)] == 18)
       {
-        float gridWidth = 16;
-        float gridHeight = 16;
-
-        for (int i = 0; i < 3; i++)
-        {
-          for (int j = 0; j < 3; j++)
-          {
-            Sprite spike;
-            spike.x = i * gridWidth + x * cellWidth + 16;
-            spike.y = j * gridHeight + y * cellWidth + 16;
-            spike.type = Spike;
-            spike.enemyLastMeleeTime = std::chrono::high_resolution_clock::now();
-            spike.enemyLastBulletTime = std::chrono::high_resolution_clock::now();
-            spike.z = 19;
-            sprites.emplace_back(spike);
-          }
-        }
+        Sprite spike;
+        spike.x = x * cellWidth + cellWidth / 2;
+        spike.y = y * cellWidth + cellWidth / 2;
+        spike.type = Spike;
+        spike.active = true;
+        spike.trap = true;
+        spike.z = 19;
+        sprites.add(spike);
+        scheduleSpikeToggle(sprites.handle(sprites.size() - 1));
+        rearmMelee(sprites.handle(sprites.size() - 1));
+        Triggers::addSpike(sprites.handle(sprites.size() - 1), spike.x, spike.y);
       }
     }
   }
+  SpriteBins::update();
+}
+
+// ray of a view that covers screen column x
+int rayForColumn(const LocalPlayer &view, int x)
+{
+  int rayCount = static_cast<int>(view.distances.size());
+  return std::clamp(static_cast<int>(((x - view.viewX) * (view.player.FOV / rayStep)) / view.viewWidth), 0, rayCount - 1);
+}
+
+// Stable LSD radix sort on the upper 32 bits of each key, one byte per pass.
+// Passes where every key has the same byte are skipped, so nearby depths usually take two or three passes
+void radixSortKeys(std::vector<uint64_t> &keys, std::vector<uint64_t> &scratch)
+{
+  scratch.resize(keys.size());
+  for (int shift = 32; shift < 64; shift += 8)
+  {
+    int counts[257] = {0};
+    for (uint64_t key : keys)
+    {
+      counts[((key >> shift) & 0xFF) + 1]++;
+    }
+    if (counts[((keys.empty() ? 0 : keys[0] >> shift) & 0xFF) + 1] == keys.size())
+      continue;
+    for (int digit = 0; digit < 256; digit++)
+    {
+      counts[digit + 1] += counts[digit];
+    }
+    for (uint64_t key : keys)
+    {
+      scratch[counts[(key >> shift) & 0xFF]++] = key;
+    }
+    keys.swap(scratch);
+  }
+}
+
+// The one way to change a map tile, keeps the tile index and the cached views of the map in step
+void setTile(int cell, int tile)
+{
+  if (cell < 0 || cell >= map.size() || map[cell] == tile)
+    return;
+  Tiles::remove(cell);
+  map[cell] = tile;
+  Tiles::add(cell);
+  mapRevision++;
+  Decals::clearCell(cell);
+  Minimap::markDirty(cell);
+  Pvs::patch(cell);
+  FlowField::markDirty();
+}
+
+// leaves blast marks on the walls around a cell a bomb just cleared
+void scorchAround(int cellX, int cellY)
+{
+  const int offsets[4][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+  const Decals::Face faces[4] = {Decals::East, Decals::West, Decals::South, Decals::North};
+  for (int i = 0; i < 4; i++)
+  {
+    int cell = getCell(cellX + offsets[i][0], cellY + offsets[i][1]);
+    if (cell == -1 || map[cell] == 0)
+      continue;
+    Decals::stamp(Decals::faceKey(cell, faces[i]), Decals::tileSize / 2, Decals::tileSize * 0.6f, Decals::Scorch);
+  }
 }
 
 void serializePlayer(const std::string &filename)
@@ -212,13 +438,10 @@ void deserializeSprites(const std::string &filename)
       }
       if (sprite.type == ShooterEnemy)
       {
-        sprite.enemyLastBulletTime = std::chrono::high_resolution_clock::now();
-        sprite.enemyLastMeleeTime = std::chrono::high_resolution_clock::now();
         sprite.move = false;
       }
       if (sprite.type == Enemy)
       {
-        sprite.enemyLastMeleeTime = std::chrono::high_resolution_clock::now();
         sprite.move = false;
       }
       if (sprite.type == DroneEnemy)
@@ -227,15 +450,12 @@ void deserializeSprites(const std::string &filename)
       }
       if (sprite.type == Spike)
       {
-        sprite.enemyLastMeleeTime = std::chrono::high_resolution_clock::now();
-        sprite.enemyLastBulletTime = std::chrono::high_resolution_clock::now();
         sprite.z = 19;
       }
       if (sprite.type == HammerEnemy)
       {
         sprite.scaleX = 1.2;
         sprite.scaleY = 1.2;
-        sprite.enemyLastMeleeTime = std::chrono::high_resolution_clock::now();
         sprite.move = false;
       }
 
@@ -243,27 +463,47 @@ void deserializeSprites(const std::string &filename)
       {
         sprite.scaleX = 1.6;
         sprite.scaleY = 1.4;
-        sprite.enemyLastMeleeTime = std::chrono::high_resolution_clock::now();
-        sprite.enemyLastBulletTime = std::chrono::high_resolution_clock::now();
         sprite.move = false;
         sprite.health = BossValues::initialBossHealth;
       }
 
       if (hasHealth)
       {
-        file.read(reinterpret_cast<char *>(&sprite.health), sizeof(float));
+        float health;
+        file.read(reinterpret_cast<char *>(&health), sizeof(float));
+        sprite.health = health;
       }
       bool hasDirection;
       file.read(reinterpret_cast<char *>(&hasDirection), sizeof(bool));
       if (hasDirection)
       {
-        file.read(reinterpret_cast<char *>(&sprite.direction), sizeof(float));
+        float direction;
+        file.read(reinterpret_cast<char *>(&direction), sizeof(float));
+        sprite.direction = direction;
       }
 
       if (!invalid)
-        sprites.emplace_back(sprite);
+      {
+        sprites.add(sprite);
+        EntityHandle added = sprites.handle(sprites.size() - 1);
+        if (sprite.type == Spike)
+        {
+          scheduleSpikeToggle(added);
+          Triggers::addSpike(added, sprite.x, sprite.y);
+        }
+        // cooldowns start with the level
+        if (meleeCooldown(sprite.type) > 0)
+        {
+          rearmMelee(added);
+        }
+        if (sprite.type == Swat)
+        {
+          startBoss(added);
+        }
+      }
     }
     file.close();
+    SpriteBins::update();
   }
   else
   {
@@ -329,6 +569,108 @@ void getRGBFromTexture(int hitType, int x, int y, uint8_t &r, uint8_t &g, uint8_
 
 float degToRad(float angle) { return angle * M_PI / 180.0; }
 
+// Grid walk from one point to another, false when a wall cell lies between them
+bool lineOfSight(float fromX, float fromY, float toX, float toY)
+{
+  float x = fromX / cellWidth;
+  float y = fromY / cellWidth;
+  int cellX = floor(x);
+  int cellY = floor(y);
+  int endX = floor(toX / cellWidth);
+  int endY = floor(toY / cellWidth);
+  float dirX = toX / cellWidth - x;
+  float dirY = toY / cellWidth - y;
+  int stepX = dirX < 0 ? -1 : 1;
+  int stepY = dirY < 0 ? -1 : 1;
+  float deltaX = dirX == 0 ? 1e30f : std::fabs(1 / dirX);
+  float deltaY = dirY == 0 ? 1e30f : std::fabs(1 / dirY);
+  float nextX = (dirX < 0 ? x - cellX : cellX + 1 - x) * deltaX;
+  float nextY = (dirY < 0 ? y - cellY : cellY + 1 - y) * deltaY;
+
+  // every step crosses one cell edge, so the end cell is always reached after this many
+  int steps = std::abs(endX - cellX) + std::abs(endY - cellY);
+  for (int s = 0; s < steps; s++)
+  {
+    if (nextX < nextY)
+    {
+      nextX += deltaX;
+      cellX += stepX;
+    }
+    else
+    {
+      nextY += deltaY;
+      cellY += stepY;
+    }
+    int cell = getCell(cellX, cellY);
+    if (cell == -1 || map[cell] != 0)
+      return false;
+  }
+  return true;
+}
+
+// Whether the player could have (x, y) on screen: inside their field of view with half a cell of slack for the
+// sprite's width, within enemyActivationRadius when that is set, and with nothing but open cells in between
+bool canSee(const Player &player, float x, float y)
+{
+  float spriteX = x - player.pos.x;
+  float spriteY = y - player.pos.y;
+  float angle = degToRad(player.angle);
+  float forward = spriteX * cos(angle) + spriteY * sin(angle);
+  float side = spriteY * cos(angle) - spriteX * sin(angle);
+  if (forward <= 0 || std::fabs(side) > forward * tan(degToRad(player.FOV / 2)) + cellWidth / 2)
+    return false;
+  if (enemyActivationRadius > 0 && spriteX * spriteX + spriteY * spriteY > enemyActivationRadius * enemyActivationRadius)
+    return false;
+  int from = getCell(floor(player.pos.x / cellWidth), floor(player.pos.y / cellWidth));
+  int to = getCell(floor(x / cellWidth), floor(y / cellWidth));
+  return Pvs::visible(from, to) && lineOfSight(player.pos.x, player.pos.y, x, y);
+}
+
+// Fraction of the way from (fromX, fromY) to (toX, toY) at which the segment first comes within radius of (x, y),
+// or -1 when it never does
+float sweepHit(float fromX, float fromY, float toX, float toY, float x, float y, float radius)
+{
+  float dx = toX - fromX;
+  float dy = toY - fromY;
+  float offsetX = fromX - x;
+  float offsetY = fromY - y;
+  float c = offsetX * offsetX + offsetY * offsetY - radius * radius;
+  if (c < 0)
+    return 0;
+  float a = dx * dx + dy * dy;
+  float b = offsetX * dx + offsetY * dy;
+  float discriminant = b * b - a * c;
+  if (a == 0 || b >= 0 || discriminant < 0)
+    return -1;
+  float t = (-b - std::sqrt(discriminant)) / a;
+  return t <= 1 ? t : -1;
+}
+
+uint32_t packColor(Uint8 r, Uint8 g, Uint8 b)
+{
+  return 0xFF000000u | (static_cast<uint32_t>(b) << 16) | (static_cast<uint32_t>(g) << 8) | r;
+}
+
+void damagePlayer(int amount)
+{
+  health -= amount;
+  PostProcess::lastDamageTime = currentTime;
+}
+
+// true only on the frame the key goes down, pressed carries the state between frames
+bool keyToggled(const Uint8 *keystate, SDL_Scancode key, bool &pressed)
+{
+  bool toggled = keystate[key] && pressed == false;
+  pressed = keystate[key];
+  return toggled;
+}
+
+void fillRowSpan(int y, int xStart, int xEnd, uint32_t color)
+{
+  uint32_t *row = frameBuffer.data() + y * screenWidth;
+  std::fill(row + xStart, row + xEnd, color);
+}
+
 SDL_Texture *loadImage(SDL_Window *window, SDL_Renderer *renderer, std::string filepath)
 {
   SDL_Texture *image = IMG_LoadTexture(renderer, filepath.c_str());